@@ -4,12 +4,14 @@
 //
 // This library contains MYASSERT, MYWARNING and MYDEBUG macroses for additional debug information.
 // Benefits over regular assert:
-//  - Prints user message and debug information to std::cerr (with coloring).
+//  - Prints user message and debug information to stderr (with coloring).
 //  - Active in both Debug and Release builds.
 //  - Can be easily switched to regular asserts by commenting one line.
 //      Header will not be included, so file can be sent to the contest system as is.
 //  - Throwns MyAssertException instead of program termination.
 //      Useful to collect fail test cases during (stress) testing.
+//  - No static constructors: startup of processes including the header is not slowed down
+//      (measure with tools/my_assert_startup.cpp).
 //
 //
 // Usage:
@@ -32,9 +34,28 @@
 */
 //
 // Documentation:
-// - Print expression and its value:
+// Features listed with a `#define` are compiled in only when the macro is defined before the include
+// (`#define MY_ASSERT_ALL_FEATURES` defines them all). Those with threads, files or sockets need POSIX; the rest is
+// standard C++ and always there.
+//
+// - Print expression and its value (structs without operator<< field by field, containers element by element,
+//   enumerators by name):
 //     `MYDEBUG(expression);`
 //
+// - Print a 2D grid as aligned columns (containers of rows, 2D arrays, mdspan-like views, row-major pointers),
+//   optionally coloring cells for which highlight(i, j) returns true or a *_FG_CODE:
+//     `#define MY_ASSERT_GRIDS` before include
+//     `MYDEBUG_GRID(grid);` `MYDEBUG_GRID(ptr, rows, cols);` `MYDEBUG_GRID(ptr, rows, cols, highlight);`
+//
+// - Dump a graph (adjacency list or CSR) to a Graphviz DOT file, written by a background thread:
+//     `#define MY_ASSERT_GRAPHS` before include
+//     `MYDEBUG_GRAPH(adjacency);` `MYDEBUG_GRAPH(offsets, targets, nodes);`
+//     `my_assert::set_graph_directory("dumps");`
+//
+// - Print from a signal handler (integers, pointers and string literals; one write(2), no allocation):
+//     `#define MY_ASSERT_SIGSAFE` before include
+//     `MYDEBUG_SIGSAFE(expression);`
+//
 // - Warning if condition is not met:
 //     `MYWARNING(condition);`
 //
@@ -42,18 +63,298 @@
 //     `MYASSERT(condition);`
 //     `MYASSERT(condition, text);`
 //
+// - Checks inside hot loops that keep them vectorizable (failures are accumulated, the first failing iteration is
+//   found by rescanning after the loop):
+//     `my_assert::accum_flag failed = 0;` `MYASSERT_ACCUM(failed, condition(i));` in the loop, then
+//     `MYASSERT_ACCUM_CHECK(failed, condition, n);` or `MYASSERT_ACCUM_CHECK(failed);`
+//
+// - Floating-point checks over spans (AVX2/AVX-512 when available, first bad index is reported):
+//     `#define MY_ASSERT_FP_CHECKS` before include
+//     `MYASSERT_FINITE(data, size);` `MYASSERT_NO_NAN(data, size);` `MYASSERT_NO_DENORMAL(data, size);`
+//
+// - Trap NaN-producing, dividing-by-zero and overflowing operations in a scope (reported via SIGFPE on Linux with
+//   glibc, checked at the end of the scope elsewhere):
+//     `#define MY_ASSERT_FP_TRAPS` before include
+//     `MYFP_TRAP(trap);` (`trap.trapped()` tells whether one fired)
+//
 // - Unreachable code:
 //     `MYUNREACHABLE();`
 //     `MYUNREACHABLE(text);`
 //
+// - Record the arguments of recent calls (trivially copyable), written to a file by the first MyAssertException (or
+//   on request), and replay them in a debug build:
+//    `#define MY_ASSERT_RECORD_ARGS` before include
+//    `MYRECORD_ARGS(input, k);` at the top of the function, `my_assert::dump_recorded_args();` in a catch
+//    `my_assert::recorded_calls("my_assert_args.1234.0.bin").replay(solve);`
+//
+// - Validate a fast result against a slow reference on a sampled fraction of calls, off the calling thread:
+//    `#define MY_ASSERT_BACKGROUND_CHECKS` before include
+//    `MYSHADOW(0.01, (n, edges), answer, brute_force);` (`my_assert::wait_shadow_checks();` to wait for them)
+//
+// - Check expensive invariants on a snapshot (copy, or std::shared_ptr<const T> version) on a worker pool:
+//    `#define MY_ASSERT_BACKGROUND_CHECKS` before include
+//    `MYASSERT_ASYNC(index, is_consistent);` (`my_assert::wait_validations();` to wait for them)
+//
 // - Catch assertion failure inside algorithm (useful for stress testing):
 //    `try { output = run_test_case(input) } catch (...) { /* save input */ }`
+//
+// - Checkpoint a long stress-testing campaign (seed cursor, corpus, failures per site, coverage counters) and
+//   resume it after a restart, without pausing the workers:
+//    `#define MY_ASSERT_STRESS` before include
+//    `my_assert::stress_campaign campaign("stress.ckpt"); campaign.start_checkpoints();`
+//    `auto& worker = campaign.add_worker();` in each thread, then `worker.begin_case()` ... `worker.end_case()`
+//
+// - Mutex with lock-order checking and contention statistics (reported at exit):
+//    `#define MY_ASSERT_CHECKED_MUTEX` before include
+//    `my_assert::checked_mutex m;`
+//    `std::lock_guard<my_assert::checked_mutex> lock(m);`
+//
+// - Buffered output from a background thread (io_uring if available); failures are still flushed before throw:
+//    `#define MY_ASSERT_ASYNC_OUTPUT` before include
+//    `my_assert::enable_async_output();`
+//    `my_assert::enable_file_output("debug.log.lz", true);` (compressed, decode with tools/my_assert_unlz)
+//    `my_assert::enable_timestamps();` (query logs by site, expression and time with tools/my_assert_logq)
+//
+// - Switch MYDEBUG/MYWARNING sites and dump statistics of a running process with tools/my_assert_ctl:
+//    `#define MY_ASSERT_CONTROL_SOCKET` before include
+//    `my_assert::start_control_socket();`
+//
+// - Time a scope (count, total, max and histogram per site):
+//    `MYTIME("solve");`
+//
+// - Publish statistics to shared memory for tools/my_assert_top:
+//    `#define MY_ASSERT_SHM_STATS` before include
+//    `my_assert::start_shm_stats();`
+//
+// - Export statistics in Prometheus text format (node exporter textfile collector):
+//    `#define MY_ASSERT_PROMETHEUS` before include
+//    `my_assert::start_prometheus_export("/var/lib/node_exporter/my_app.prom");`
+//    `#define MY_ASSERT_EVAL_COUNTERS` before include also counts evaluations of MYASSERT/MYWARNING
+//
+// - Site rules, timestamps and output from a config file, reloaded on change:
+//    `#define MY_ASSERT_CONFIG_FILE` before include
+//    `my_assert::watch_config("my_assert.conf");`
+//
+// - Bound the cost of checks: with `#define MY_ASSERT_ADAPTIVE` before include, MYASSERT conditions costing more
+//   than a fraction of runtime are demoted to sampled evaluation:
+//    `my_assert::set_assert_cost_budget(0.02);`
+//
+// - Compile checks in or out per level (NONE, ASSERT, WARNING, DEBUG), globally or per module:
+//    `-DMY_ASSERT_LEVEL=MY_ASSERT_LEVEL_WARNING`
+//    `#define MY_ASSERT_MODULE io` before include, then `-DMY_ASSERT_LEVEL_io=MY_ASSERT_LEVEL_ASSERT`
+//
+// - fork() is safe with buffered output: the parent flushes, the child restarts the flusher on its first record.
+//   Optionally zero the statistics in children:
+//    `my_assert::reset_stats_on_fork();`
+//
+// - Real-time threads: with `#define MY_ASSERT_REALTIME` before include the macros never allocate, lock or throw
+//   (MYDEBUG prints integers, pointers and string literals); records go through a per-thread ring:
+//    `my_assert::realtime_thread_init();` in each thread, `my_assert::realtime_failed()` to poll failures
 
 #pragma once
 
-#include <iostream>
+// -------------------------
+// === Optional features ===
+// -------------------------
+// The macros, printing and site statistics need only standard C++ and are always there. Every other feature is
+// enabled per translation unit by its macro, defined before the include, so that a plain include stays cheap to
+// compile. MY_ASSERT_ALL_FEATURES enables all of them. Translation units may enable different features.
+#ifdef MY_ASSERT_ALL_FEATURES
+#    ifndef MY_ASSERT_ASYNC_OUTPUT
+#        define MY_ASSERT_ASYNC_OUTPUT
+#    endif
+#    ifndef MY_ASSERT_SIGSAFE
+#        define MY_ASSERT_SIGSAFE
+#    endif
+#    ifndef MY_ASSERT_GRIDS
+#        define MY_ASSERT_GRIDS
+#    endif
+#    ifndef MY_ASSERT_GRAPHS
+#        define MY_ASSERT_GRAPHS
+#    endif
+#    ifndef MY_ASSERT_FP_CHECKS
+#        define MY_ASSERT_FP_CHECKS
+#    endif
+#    ifndef MY_ASSERT_FP_TRAPS
+#        define MY_ASSERT_FP_TRAPS
+#    endif
+#    ifndef MY_ASSERT_CHECKED_MUTEX
+#        define MY_ASSERT_CHECKED_MUTEX
+#    endif
+#    ifndef MY_ASSERT_CONTROL_SOCKET
+#        define MY_ASSERT_CONTROL_SOCKET
+#    endif
+#    ifndef MY_ASSERT_SHM_STATS
+#        define MY_ASSERT_SHM_STATS
+#    endif
+#    ifndef MY_ASSERT_PROMETHEUS
+#        define MY_ASSERT_PROMETHEUS
+#    endif
+#    ifndef MY_ASSERT_CONFIG_FILE
+#        define MY_ASSERT_CONFIG_FILE
+#    endif
+#    ifndef MY_ASSERT_RECORD_ARGS
+#        define MY_ASSERT_RECORD_ARGS
+#    endif
+#    ifndef MY_ASSERT_BACKGROUND_CHECKS
+#        define MY_ASSERT_BACKGROUND_CHECKS
+#    endif
+#    ifndef MY_ASSERT_STRESS
+#        define MY_ASSERT_STRESS
+#    endif
+#endif
+
+// Features built on others
+#if defined(MY_ASSERT_CONFIG_FILE) && !defined(MY_ASSERT_ASYNC_OUTPUT)
+#    define MY_ASSERT_ASYNC_OUTPUT // "output" setting
+#endif
+#if defined(MY_ASSERT_GRAPHS) && !defined(MY_ASSERT_GRIDS)
+#    define MY_ASSERT_GRIDS // number formatting
+#endif
+
+// Parts shared by several features
+#if defined(MY_ASSERT_SIGSAFE) || defined(MY_ASSERT_REALTIME) || (defined(MY_ASSERT_FP_TRAPS) && defined(__linux__))
+#    define MY_ASSERT_HAS_SIGSAFE_LINE // records formatted without allocation
+#endif
+#if defined(MY_ASSERT_CONTROL_SOCKET) || defined(MY_ASSERT_CONFIG_FILE)
+#    define MY_ASSERT_HAS_SITE_RULES // enable/disable/rate rules
+#endif
+#if defined(MY_ASSERT_EVAL_COUNTERS) || defined(MY_ASSERT_CONTROL_SOCKET) || defined(MY_ASSERT_SHM_STATS) ||           \
+    defined(MY_ASSERT_PROMETHEUS)
+#    define MY_ASSERT_HAS_EVAL_COUNTERS // per-thread evaluation counters and their sums
+#endif
+#if defined(MY_ASSERT_ASYNC_OUTPUT) || defined(MY_ASSERT_REALTIME) || defined(MY_ASSERT_GRAPHS) ||                     \
+    defined(MY_ASSERT_CHECKED_MUTEX) || defined(MY_ASSERT_CONTROL_SOCKET) || defined(MY_ASSERT_SHM_STATS) ||           \
+    defined(MY_ASSERT_PROMETHEUS) || defined(MY_ASSERT_CONFIG_FILE) || defined(MY_ASSERT_BACKGROUND_CHECKS) ||         \
+    defined(MY_ASSERT_STRESS)
+#    define MY_ASSERT_HAS_THREADS // locks or background threads
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#    define MY_ASSERT_HAS_FORK_HANDLERS // pthread_atfork
+#endif
+#if defined(MY_ASSERT_ASYNC_OUTPUT) || defined(MY_ASSERT_REALTIME) || defined(MY_ASSERT_GRAPHS) ||                     \
+    defined(MY_ASSERT_CONTROL_SOCKET) || defined(MY_ASSERT_SHM_STATS) || defined(MY_ASSERT_PROMETHEUS) ||              \
+    defined(MY_ASSERT_CONFIG_FILE) || defined(MY_ASSERT_RECORD_ARGS) || defined(MY_ASSERT_STRESS) ||                   \
+    defined(MY_ASSERT_HAS_SIGSAFE_LINE)
+#    define MY_ASSERT_HAS_POSIX_IO // file descriptors
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <ostream>
 #include <sstream>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#ifdef MY_ASSERT_HAS_THREADS
+#    include <condition_variable>
+#    include <mutex>
+#    include <system_error>
+#    include <thread>
+#    include <vector>
+#endif
+#ifdef MY_ASSERT_GRIDS
+#    include <charconv>
+#    include <vector>
+#endif
+#if defined(MY_ASSERT_CHECKED_MUTEX) || defined(MY_ASSERT_STRESS)
+#    include <unordered_map>
+#endif
+#if defined(MY_ASSERT_BACKGROUND_CHECKS) || defined(MY_ASSERT_STRESS)
+#    include <deque>
+#    include <memory>
+#endif
+#if defined(MY_ASSERT_CONFIG_FILE) || defined(MY_ASSERT_RECORD_ARGS) || defined(MY_ASSERT_STRESS)
+#    include <fstream>
+#endif
+#ifdef MY_ASSERT_RECORD_ARGS
+#    include <exception>
+#    include <vector>
+#endif
+#ifdef MY_ASSERT_FP_TRAPS
+#    include <cfenv>
+#endif
+#if defined(MY_ASSERT_FP_CHECKS) && (defined(__x86_64__) || defined(__i386__))
+#    include <x86intrin.h>
+#endif
+
+// POSIX headers, only for the features that need them
+#ifdef MY_ASSERT_HAS_POSIX_IO
+#    include <cerrno>
+#    include <fcntl.h>
+#    include <unistd.h>
+#endif
+#ifdef MY_ASSERT_HAS_FORK_HANDLERS
+#    include <pthread.h>
+#endif
+#ifdef MY_ASSERT_HAS_SIGSAFE_LINE
+#    include <time.h>
+#endif
+#if defined(MY_ASSERT_ASYNC_OUTPUT) || defined(MY_ASSERT_SHM_STATS)
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#endif
+#ifdef MY_ASSERT_CONTROL_SOCKET
+#    include <sys/socket.h>
+#    include <sys/time.h>
+#    include <sys/un.h>
+#endif
+
+#if defined(__linux__)
+#    if defined(MY_ASSERT_ASYNC_OUTPUT) || defined(MY_ASSERT_REALTIME)
+#        include <sys/syscall.h>
+#    endif
+#    ifdef MY_ASSERT_REALTIME
+#        include <linux/futex.h>
+#    endif
+#    ifdef MY_ASSERT_BACKGROUND_CHECKS
+#        include <sched.h>
+#    endif
+#    ifdef MY_ASSERT_CONFIG_FILE
+#        include <sys/inotify.h>
+#    endif
+#    ifdef MY_ASSERT_FP_TRAPS
+#        include <signal.h>
+#        include <ucontext.h>
+#    endif
+#elif defined(MY_ASSERT_CONFIG_FILE)
+#    include <filesystem>
+#endif
+
+#if defined(MY_ASSERT_ASYNC_OUTPUT) && defined(__linux__) && __has_include(<linux/io_uring.h>)
+#    include <linux/io_uring.h>
+#    include <sys/uio.h>
+#    define MY_ASSERT_HAS_IO_URING
+#endif
+#if defined(MY_ASSERT_FP_TRAPS) && defined(__linux__) && defined(__GLIBC__)
+#    define MY_ASSERT_HAS_FP_TRAPS // feenableexcept
+#endif
+
+// -------------------------------
+// === Constant initialization ===
+// -------------------------------
+// Library globals are constant-initialized: including the header adds no static constructors (no <iostream>
+// either), and sinks, registries and clocks are set up on first use. The marker makes the compiler verify it.
+#if defined(__cpp_constinit)
+#    define MY_ASSERT_CONSTINIT constinit
+#elif defined(__clang__)
+#    define MY_ASSERT_CONSTINIT [[clang::require_constant_initialization]]
+#elif defined(__GNUC__) && __GNUC__ >= 10
+#    define MY_ASSERT_CONSTINIT __constinit
+#else
+#    define MY_ASSERT_CONSTINIT
+#endif
 
 // --------------------------------
 // === Argument stringification ===
@@ -61,6 +362,12 @@
 #define TOSTR_IMPL(x) #x
 #define TOSTR(x) TOSTR_IMPL(x)
 
+// ---------------------------
+// === Token concatenation ===
+// ---------------------------
+#define CONCAT_IMPL(a, b) a##b
+#define CONCAT(a, b) CONCAT_IMPL(a, b)
+
 // ---------------------
 // === Code location ===
 // ---------------------
@@ -102,6 +409,10 @@
 
 #define FORMATTED_STR_IMPL(text, code_start, code_end) FORMATTED_STR_IMPL_(text, code_start, code_end)
 
+// for runtime strings: oss << FORMAT_BEGIN(BOLD_CODE) << text << FORMAT_END
+#define FORMAT_BEGIN(code) "\033[1;" TOSTR(code) "m"
+#define FORMAT_END "\033[" TOSTR(RESET_CODE) "m"
+
 #define BLACK_STR(text) FORMATTED_STR_IMPL(text, BLACK_FG_CODE, RESET_CODE)
 #define RED_STR(text) FORMATTED_STR_IMPL(text, RED_FG_CODE, RESET_CODE)
 #define GREEN_STR(text) FORMATTED_STR_IMPL(text, GREEN_FG_CODE, RESET_CODE)
@@ -115,22 +426,147 @@
 #define UNDERLINE_STR(text) FORMATTED_STR_IMPL(text, UNDERLINE_CODE, RESET_CODE)
 #define INVERSE_STR(text) FORMATTED_STR_IMPL(text, INVERSE_CODE, RESET_CODE)
 
+// ---------------------------
+// === Compile-time levels ===
+// ---------------------------
+// Global level: -DMY_ASSERT_LEVEL=MY_ASSERT_LEVEL_WARNING. Per module: `#define MY_ASSERT_MODULE io` before include
+// and -DMY_ASSERT_LEVEL_io=MY_ASSERT_LEVEL_ASSERT. Levels are numbers (0..3); checks above the level compile away.
+// Their names are prefixed, because bare names collide with common user macros (-DDEBUG would turn DEBUG into 1,
+// i.e. ASSERT): modules cannot be named NONE, ASSERT, WARNING or DEBUG.
+// The level is a constant of the translation unit (an unnamed namespace). Use module levels only in non-inline code
+// of the module: an inline function, template or in-class member function with checks, defined in a header that
+// modules with different levels include, has a different definition in each of them (an ODR violation), and the
+// linker keeps one of them for the whole program.
+#define MY_ASSERT_LEVEL_NONE 0
+#define MY_ASSERT_LEVEL_ASSERT 1
+#define MY_ASSERT_LEVEL_WARNING 2
+#define MY_ASSERT_LEVEL_DEBUG 3
+#ifndef MY_ASSERT_LEVEL
+#    define MY_ASSERT_LEVEL MY_ASSERT_LEVEL_DEBUG
+#endif
+
+namespace my_assert
+{
+namespace detail
+{
+// A module level is resolved by pasting its value, which tells a defined MY_ASSERT_LEVEL_<module> from one that
+// is not.
+struct level_names
+{
+    enum : int
+    {
+        my_assert_level_0 = 0,
+        my_assert_level_1 = 1,
+        my_assert_level_2 = 2,
+        my_assert_level_3 = 3,
+    };
+};
+} // namespace detail
+
+namespace
+{
+struct global_level
+{
+    static constexpr int value = MY_ASSERT_LEVEL;
+    static_assert(value >= MY_ASSERT_LEVEL_NONE && value <= MY_ASSERT_LEVEL_DEBUG,
+                  "MY_ASSERT_LEVEL must be MY_ASSERT_LEVEL_NONE, _ASSERT, _WARNING or _DEBUG");
+};
+
+#ifdef MY_ASSERT_MODULE
+// Fallback for an undefined MY_ASSERT_LEVEL_<module>; a defined one names a level_names member, which hides it.
+constexpr int CONCAT(my_assert_level_, CONCAT(MY_ASSERT_LEVEL_, MY_ASSERT_MODULE)) = global_level::value;
+
+struct module_level : detail::level_names
+{
+    static constexpr int value = CONCAT(my_assert_level_, CONCAT(MY_ASSERT_LEVEL_, MY_ASSERT_MODULE));
+};
+#else
+using module_level = global_level;
+#endif
+} // namespace
+} // namespace my_assert
+
+// `if constexpr (MY_ASSERT_ENABLED(DEBUG)) { ... }` for checks of your own
+#define MY_ASSERT_ENABLED(level)                                                                                       \
+    (my_assert::module_level::value >= MY_ASSERT_LEVEL_##level)
+
 // --------------------------
 // === Assertion macroses ===
 // --------------------------
 
+// Per-thread evaluation counters of MYASSERT/MYWARNING (opt-in: #define MY_ASSERT_EVAL_COUNTERS before include)
+#ifdef MY_ASSERT_EVAL_COUNTERS
+#    define MY_ASSERT_COUNT_EVALUATION(site) my_assert::detail::count_evaluation(site)
+#else
+#    define MY_ASSERT_COUNT_EVALUATION(site) void(0)
+#endif
+
+// Cost-adaptive MYASSERT (opt-in: #define MY_ASSERT_ADAPTIVE before include): condition cost is sampled,
+// and sites exceeding the budget (my_assert::set_assert_cost_budget) are switched to sampled evaluation.
+#ifdef MY_ASSERT_ADAPTIVE
+#    define MY_ASSERT_CHECK_FAILED(site, x) my_assert::detail::adaptive_check_failed(site, [&] { return !(x); })
+#else
+#    define MY_ASSERT_CHECK_FAILED(site, x) (!(x))
+#endif
+
+// Real-time mode (opt-in: #define MY_ASSERT_REALTIME before include, then my_assert::realtime_thread_init() in
+// each thread): no allocation, locks or exceptions on any macro path, see "Real-time mode" below.
+// #define MY_ASSERT_REALTIME_EXCEPTIONS to throw MyAssertException on failures anyway.
+#ifdef MY_ASSERT_REALTIME
+#    if defined(MY_ASSERT_ADAPTIVE) || defined(MY_ASSERT_EVAL_COUNTERS)
+#        error "MY_ASSERT_REALTIME cannot be combined with MY_ASSERT_ADAPTIVE or MY_ASSERT_EVAL_COUNTERS"
+#    endif
+#    ifdef MY_ASSERT_REALTIME_EXCEPTIONS
+#        define MY_ASSERT_REALTIME_THROW(text) throw my_assert::MyAssertException{(text), LOCATION}
+#    else
+#        define MY_ASSERT_REALTIME_THROW(text) void(0)
+#    endif
+#endif
+
+// Reports shared by both modes have a real-time variant, realtime_<name>.
+#ifdef MY_ASSERT_REALTIME
+#    define MY_ASSERT_REPORT(name) my_assert::detail::realtime_##name
+#else
+#    define MY_ASSERT_REPORT(name) my_assert::detail::name
+#endif
+
 // Assertions
-#define MYASSERT_IMPL(x, text)                                                                                         \
+#ifdef MY_ASSERT_REALTIME
+#    define MYASSERT_IMPL(x, text)                                                                                     \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (MY_ASSERT_ENABLED(ASSERT))                                                                       \
+        {                                                                                                              \
+            static my_assert::detail::site_stats my_assert_site{LOCATION, my_assert::detail::site_kind::assertion,     \
+                #x};                                                                                                   \
+            if (!(x))                                                                                                  \
+            {                                                                                                          \
+                my_assert::detail::realtime_failure(                                                                   \
+                    my_assert_site, BOLD_STR(LOCATION ": ") RED_STR("assertion check failed: "), text);                \
+                MY_ASSERT_REALTIME_THROW(text);                                                                        \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+#else
+#    define MYASSERT_IMPL(x, text)                                                                                     \
     do                                                                                                                 \
     {                                                                                                                  \
-        if (!(x))                                                                                                      \
+        if constexpr (MY_ASSERT_ENABLED(ASSERT))                                                                       \
         {                                                                                                              \
-            std::ostringstream oss;                                                                                    \
-            oss << BOLD_STR(LOCATION ": ") << RED_STR("assertion check failed: ") << (text) << std::endl;              \
-            std::cerr << oss.str();                                                                                    \
-            throw my_assert::MyAssertException{(text), LOCATION};                                                      \
+            static my_assert::detail::site_stats my_assert_site{LOCATION, my_assert::detail::site_kind::assertion,     \
+                #x};                                                                                                   \
+            MY_ASSERT_COUNT_EVALUATION(my_assert_site);                                                                \
+            if (MY_ASSERT_CHECK_FAILED(my_assert_site, x))                                                             \
+            {                                                                                                          \
+                my_assert::detail::site_failed(my_assert_site);                                                        \
+                std::ostringstream oss;                                                                                \
+                oss << BOLD_STR(LOCATION ": ") << RED_STR("assertion check failed: ") << (text) << std::endl;          \
+                my_assert::detail::emit_failure(oss.str());                                                            \
+                throw my_assert::MyAssertException{(text), LOCATION};                                                  \
+            }                                                                                                          \
         }                                                                                                              \
     } while (false)
+#endif
 #define MYASSERT(x, ...) MYASSERT_(x, ##__VA_ARGS__, 2, 1)
 #define MYASSERT_(x, text, n, ...) MYASSERT##n(x, text)
 #define MYASSERT1(x, ...) MYASSERT_IMPL(x, #x)
@@ -138,47 +574,309 @@
 
 // Unreachable code
 // Assertions
-#define MYUNREACHEABLE_IMPL(text)                                                                                      \
+#ifdef MY_ASSERT_REALTIME
+#    define MYUNREACHEABLE_IMPL(text)                                                                                  \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        my_assert::detail::realtime_unreachable(BOLD_STR(LOCATION ": ") RED_STR("unreacheable code. "), text);         \
+        MY_ASSERT_REALTIME_THROW(text);                                                                                \
+        std::abort();                                                                                                  \
+    } while (false)
+#else
+#    define MYUNREACHEABLE_IMPL(text)                                                                                  \
     do                                                                                                                 \
     {                                                                                                                  \
         std::ostringstream oss;                                                                                        \
         oss << BOLD_STR(LOCATION ": ") << RED_STR("unreacheable code. ") << (text) << std::endl;                       \
-        std::cerr << oss.str();                                                                                        \
+        my_assert::detail::emit_failure(oss.str());                                                                    \
         throw my_assert::MyAssertException{(text), LOCATION};                                                          \
     } while (false)
+#endif
 #define MYUNREACHABLE(ZeroOrOneArg...) MYUNREACHEABLE_IMPL("" ZeroOrOneArg)
 
 // Debug printing
 // TODO: add support for multiple arguments
-#define MYDEBUG(expr)                                                                                                  \
+// Sites can be switched off and rate limited at runtime (see my_assert::start_control_socket).
+#ifdef MY_ASSERT_REALTIME
+#    define MYDEBUG(expr)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (MY_ASSERT_ENABLED(DEBUG))                                                                        \
+        {                                                                                                              \
+            static my_assert::detail::site_stats my_assert_site{LOCATION, my_assert::detail::site_kind::debug, #expr}; \
+            if (my_assert::detail::realtime_site_enabled(my_assert_site) &&                                            \
+                my_assert::detail::site_admit(my_assert_site))                                                         \
+            {                                                                                                          \
+                my_assert::detail::realtime_debug(                                                                     \
+                    my_assert_site, BOLD_STR(LOCATION ": ") YELLOW_STR("debug: ") TOSTR(expr) " = ", (expr));          \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+#else
+#    define MYDEBUG(expr)                                                                                              \
                                                                                                                        \
     do                                                                                                                 \
     {                                                                                                                  \
-        std::ostringstream oss;                                                                                        \
-        oss << BOLD_STR(LOCATION ": ") << YELLOW_STR("debug: ") << TOSTR(expr) << " = " << (expr) << std::endl;        \
-        std::cerr << oss.str();                                                                                        \
+        if constexpr (MY_ASSERT_ENABLED(DEBUG))                                                                        \
+        {                                                                                                              \
+            static my_assert::detail::site_stats my_assert_site{LOCATION, my_assert::detail::site_kind::debug, #expr}; \
+            if (my_assert::detail::site_enabled(my_assert_site) && my_assert::detail::site_admit(my_assert_site))      \
+            {                                                                                                          \
+                std::ostringstream oss;                                                                                \
+                oss << BOLD_STR(LOCATION ": ") << YELLOW_STR("debug: ") << TOSTR(expr)                                 \
+                    << " = " << my_assert::detail::printable(expr) << std::endl;                                       \
+                my_assert::detail::emit(oss.str());                                                                    \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+#endif
+
+// Debug printing from signal handlers: integers, pointers and string literals only, no allocation or locks.
+// The record is written with a single write(2); sites cannot be switched at runtime.
+#ifdef MY_ASSERT_SIGSAFE
+#    define MYDEBUG_SIGSAFE(expr)                                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (MY_ASSERT_ENABLED(DEBUG))                                                                        \
+        {                                                                                                              \
+            my_assert::detail::sigsafe_line my_assert_line;                                                            \
+            my_assert_line.append(BOLD_STR(LOCATION ": ") YELLOW_STR("debug: ") TOSTR(expr) " = ");                    \
+            my_assert_line.append_value(expr);                                                                         \
+            my_assert_line.append("\n");                                                                               \
+            my_assert_line.write();                                                                                    \
+        }                                                                                                              \
+    } while (false)
+#endif
+
+// Debug printing of 2D grids: MYDEBUG_GRID(grid), MYDEBUG_GRID(ptr, rows, cols), optionally followed by
+// highlight(i, j) returning a *_FG_CODE (or bool) for cells to color. Not available in real-time mode.
+#if defined(MY_ASSERT_GRIDS) && !defined(MY_ASSERT_REALTIME)
+#    define MYDEBUG_GRID(...) MYDEBUG_GRID_(__VA_ARGS__, 4, 3, 2, 1)
+#    define MYDEBUG_GRID_(a, b, c, d, n, ...) MYDEBUG_GRID##n(a, b, c, d)
+#    define MYDEBUG_GRID1(grid, ...)                                                                                   \
+        MYDEBUG_GRID_IMPL(#grid, my_assert::detail::grid_of(grid), my_assert::detail::no_highlight{})
+#    define MYDEBUG_GRID2(grid, highlight, ...) MYDEBUG_GRID_IMPL(#grid, my_assert::detail::grid_of(grid), highlight)
+#    define MYDEBUG_GRID3(ptr, rows, cols, ...)                                                                        \
+        MYDEBUG_GRID_IMPL(#ptr, my_assert::detail::grid_of(ptr, rows, cols), my_assert::detail::no_highlight{})
+#    define MYDEBUG_GRID4(ptr, rows, cols, highlight)                                                                  \
+        MYDEBUG_GRID_IMPL(#ptr, my_assert::detail::grid_of(ptr, rows, cols), highlight)
+#    define MYDEBUG_GRID_IMPL(text, grid, highlight)                                                                   \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (MY_ASSERT_ENABLED(DEBUG))                                                                        \
+        {                                                                                                              \
+            static my_assert::detail::site_stats my_assert_site{LOCATION, my_assert::detail::site_kind::debug, text};  \
+            if (my_assert::detail::site_enabled(my_assert_site) && my_assert::detail::site_admit(my_assert_site))      \
+            {                                                                                                          \
+                my_assert::detail::emit(my_assert::detail::format_grid(                                                \
+                    BOLD_STR(LOCATION ": ") YELLOW_STR("debug: ") text, grid, highlight));                             \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+#endif
+
+// Graphviz dumps of graphs, written by a background thread: MYDEBUG_GRAPH(adjacency) for a container of edge lists
+// (targets or (target, weight) pairs), MYDEBUG_GRAPH(offsets, targets, nodes) for CSR. Not available in real-time mode.
+#if defined(MY_ASSERT_GRAPHS) && !defined(MY_ASSERT_REALTIME)
+#    define MYDEBUG_GRAPH(...) MYDEBUG_GRAPH_(__VA_ARGS__, 3, 2, 1)
+#    define MYDEBUG_GRAPH_(a, b, c, n, ...) MYDEBUG_GRAPH##n(a, b, c)
+#    define MYDEBUG_GRAPH1(graph, ...) MYDEBUG_GRAPH_IMPL(#graph, graph)
+#    define MYDEBUG_GRAPH3(offsets, targets, nodes) MYDEBUG_GRAPH_IMPL(#offsets ", " #targets, offsets, targets, nodes)
+#    define MYDEBUG_GRAPH_IMPL(text, ...)                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (MY_ASSERT_ENABLED(DEBUG))                                                                        \
+        {                                                                                                              \
+            static my_assert::detail::site_stats my_assert_site{LOCATION, my_assert::detail::site_kind::debug, text};  \
+            if (my_assert::detail::site_enabled(my_assert_site) && my_assert::detail::site_admit(my_assert_site))      \
+            {                                                                                                          \
+                my_assert::detail::dump_graph(my_assert_site, __VA_ARGS__);                                            \
+            }                                                                                                          \
+        }                                                                                                              \
     } while (false)
+#endif
 
 // Warnings
-#define MYWARNING(expr)                                                                                                \
+#ifdef MY_ASSERT_REALTIME
+#    define MYWARNING(expr)                                                                                            \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (MY_ASSERT_ENABLED(WARNING))                                                                      \
+        {                                                                                                              \
+            static my_assert::detail::site_stats my_assert_site{LOCATION, my_assert::detail::site_kind::warning,       \
+                #expr};                                                                                                \
+            if (my_assert::detail::realtime_site_enabled(my_assert_site) && !(expr) &&                                 \
+                my_assert::detail::site_admit(my_assert_site))                                                         \
+            {                                                                                                          \
+                my_assert::detail::realtime_warning(                                                                   \
+                    my_assert_site, BOLD_STR(LOCATION ": ") MAGENTA_STR("warning check failed: ") #expr);              \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+#else
+#    define MYWARNING(expr)                                                                                            \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (MY_ASSERT_ENABLED(WARNING))                                                                      \
+        {                                                                                                              \
+            static my_assert::detail::site_stats my_assert_site{LOCATION, my_assert::detail::site_kind::warning,       \
+                #expr};                                                                                                \
+            if (my_assert::detail::site_enabled(my_assert_site) &&                                                     \
+                (MY_ASSERT_COUNT_EVALUATION(my_assert_site), !(expr)) &&                                               \
+                my_assert::detail::site_admit(my_assert_site))                                                         \
+            {                                                                                                          \
+                std::ostringstream oss;                                                                                \
+                oss << BOLD_STR(LOCATION ": ") << MAGENTA_STR("warning check failed: ") << #expr << std::endl;         \
+                my_assert::detail::emit(oss.str());                                                                    \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+#endif
+
+// Floating-point span checks for float and double: MYASSERT_FINITE(data, size), MYASSERT_NO_NAN(data, size),
+// MYASSERT_NO_DENORMAL(data, size). Exponent bits are tested with AVX2/AVX-512 when the CPU has them.
+#ifdef MY_ASSERT_FP_CHECKS
+#    define MYASSERT_FP_IMPL(data, size, check)                                                                        \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (MY_ASSERT_ENABLED(ASSERT))                                                                       \
+        {                                                                                                              \
+            static my_assert::detail::site_stats my_assert_site{LOCATION, my_assert::detail::site_kind::assertion,     \
+                #data};                                                                                                \
+            MY_ASSERT_COUNT_EVALUATION(my_assert_site);                                                                \
+            const auto* my_assert_data = (data);                                                                       \
+            auto my_assert_size = static_cast<std::size_t>(size);                                                      \
+            if (my_assert::detail::fp_any_bad(my_assert_data, my_assert_size, my_assert::detail::fp_check::check))     \
+            {                                                                                                          \
+                MY_ASSERT_REPORT(fp_check_failed)(my_assert_site, LOCATION, #data, my_assert_data, my_assert_size,     \
+                                                  my_assert::detail::fp_check::check);                                 \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+#    define MYASSERT_FINITE(data, size) MYASSERT_FP_IMPL(data, size, finite)
+#    define MYASSERT_NO_NAN(data, size) MYASSERT_FP_IMPL(data, size, nan)
+#    define MYASSERT_NO_DENORMAL(data, size) MYASSERT_FP_IMPL(data, size, denormal)
+#endif
+
+// Loop checks that keep the loop vectorizable: MYASSERT_ACCUM(flag, condition) ORs failures into a local
+// my_assert::accum_flag without branching (GCC does not vectorize a bool accumulator). After the loop,
+// MYASSERT_ACCUM_CHECK(flag) throws if any iteration failed, and MYASSERT_ACCUM_CHECK(flag, condition, count) also
+// rescans [0, count) calling condition(i) to report the first failing iteration (condition is usually a lambda over
+// the loop's data, also used in MYASSERT_ACCUM).
+#define MYASSERT_ACCUM(flag, x)                                                                                        \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (MY_ASSERT_ENABLED(ASSERT))                                                                       \
+        {                                                                                                              \
+            static_assert(!std::is_same_v<std::decay_t<decltype(flag)>, bool>,                                         \
+                          "MYASSERT_ACCUM needs an integer flag (my_assert::accum_flag)");                             \
+            (flag) |= static_cast<my_assert::accum_flag>(!(x));                                                        \
+        }                                                                                                              \
+    } while (false)
+#define MYASSERT_ACCUM_CHECK(...) MYASSERT_ACCUM_CHECK_(__VA_ARGS__, 3, 2, 1)
+#define MYASSERT_ACCUM_CHECK_(a, b, c, n, ...) MYASSERT_ACCUM_CHECK##n(a, b, c)
+#define MYASSERT_ACCUM_CHECK1(flag, ...)                                                                               \
+    MYASSERT_ACCUM_CHECK_IMPL(flag, #flag,                                                                             \
+                              MY_ASSERT_REPORT(accum_check_failed)(my_assert_site, LOCATION, #flag, 0, 0, 0))
+#define MYASSERT_ACCUM_CHECK3(flag, condition, count)                                                                  \
+    MYASSERT_ACCUM_CHECK_IMPL(flag, #condition,                                                                        \
+                              MY_ASSERT_REPORT(accum_rescan_failed)(my_assert_site, LOCATION, #condition, condition,   \
+                                                                    static_cast<std::size_t>(count)))
+#define MYASSERT_ACCUM_CHECK_IMPL(flag, text, report)                                                                  \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (MY_ASSERT_ENABLED(ASSERT))                                                                       \
+        {                                                                                                              \
+            static my_assert::detail::site_stats my_assert_site{LOCATION, my_assert::detail::site_kind::assertion,     \
+                text};                                                                                                 \
+            MY_ASSERT_COUNT_EVALUATION(my_assert_site);                                                                \
+            if (__builtin_expect(static_cast<bool>(flag), 0))                                                          \
+            {                                                                                                          \
+                report;                                                                                                \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+
+// Shadow checking against a reference implementation: on a sampled fraction (rate, 0..1) of executions, copies of the
+// inputs, written in parentheses, and of the result are queued, and a background thread reports a mismatch if
+// reference(inputs...) != result. The reference is copied too: do not capture locals by reference.
+// Not available in real-time mode.
+#if defined(MY_ASSERT_BACKGROUND_CHECKS) && !defined(MY_ASSERT_REALTIME)
+#    define MYSHADOW(rate, inputs, fast_result, reference)                                                             \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (MY_ASSERT_ENABLED(ASSERT))                                                                       \
+        {                                                                                                              \
+            static my_assert::detail::site_stats my_assert_site{LOCATION, my_assert::detail::site_kind::assertion,     \
+                #fast_result};                                                                                         \
+            if (__builtin_expect(my_assert::detail::shadow_sampled(rate), 0))                                          \
+            {                                                                                                          \
+                MY_ASSERT_COUNT_EVALUATION(my_assert_site);                                                            \
+                my_assert::detail::submit_shadow(my_assert_site, #inputs, #fast_result, #reference,                    \
+                                                 my_assert::detail::shadow_inputs inputs, (fast_result), reference);   \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+#endif
+
+// Asynchronous invariant validation: takes a snapshot of object (a copy into a recycled buffer, or a
+// std::shared_ptr<const T> version as is) and checks validator(snapshot) on a worker pool; failures are reported
+// with the site and the sequence number of the snapshot, without throwing. The validator is copied with the job.
+// Not available in real-time mode.
+#if defined(MY_ASSERT_BACKGROUND_CHECKS) && !defined(MY_ASSERT_REALTIME)
+#    define MYASSERT_ASYNC(object, validator)                                                                          \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (MY_ASSERT_ENABLED(ASSERT))                                                                       \
+        {                                                                                                              \
+            static my_assert::detail::site_stats my_assert_site{LOCATION, my_assert::detail::site_kind::assertion,     \
+                #validator "(" #object ")"};                                                                           \
+            MY_ASSERT_CONSTINIT static std::atomic<std::uint64_t> my_assert_sequence{0};                               \
+            MY_ASSERT_COUNT_EVALUATION(my_assert_site);                                                                \
+            my_assert::detail::submit_validation(my_assert_site, my_assert_sequence, #object, #validator, (object),    \
+                                                 validator);                                                           \
+        }                                                                                                              \
+    } while (false)
+#endif
+
+// Records the arguments of the enclosing call (trivially copyable, up to 256 bytes) in a per-thread ring of the last
+// 64 calls; the ring is written to a file when the thread throws the first MyAssertException of the process. See
+// my_assert::recorded_calls.
+#ifdef MY_ASSERT_RECORD_ARGS
+#    define MYRECORD_ARGS(...)                                                                                         \
     do                                                                                                                 \
     {                                                                                                                  \
-        if (!(expr))                                                                                                   \
+        if constexpr (MY_ASSERT_ENABLED(ASSERT))                                                                       \
         {                                                                                                              \
-            std::ostringstream oss;                                                                                    \
-            oss << BOLD_STR(LOCATION ": ") << MAGENTA_STR("warning check failed: ") << #expr << std::endl;             \
-            std::cerr << oss.str();                                                                                    \
+            my_assert::detail::record_args(LOCATION, __VA_ARGS__);                                                     \
         }                                                                                                              \
     } while (false)
+#endif
 
 namespace my_assert
 {
+using accum_flag = unsigned; // failure accumulator of MYASSERT_ACCUM
+
+#ifdef MY_ASSERT_RECORD_ARGS
+namespace detail
+{
+// Called when a MyAssertException is created (installed by MYRECORD_ARGS to write the recorded arguments).
+MY_ASSERT_CONSTINIT inline std::atomic<void (*)()> g_assert_exception_hook{nullptr};
+} // namespace detail
+#endif
+
 class MyAssertException : public std::runtime_error
 {
 public:
     explicit MyAssertException(const std::string& message, const std::string& location = "")
         : std::runtime_error(compose_message(message, location))
     {
+#ifdef MY_ASSERT_RECORD_ARGS
+        if (auto* hook = detail::g_assert_exception_hook.load(std::memory_order_relaxed))
+        {
+            hook();
+        }
+#endif
     }
 
 private:
@@ -190,3 +888,6203 @@ private:
     }
 };
 } // namespace my_assert
+
+// ---------------------
+// === Low-level I/O ===
+// ---------------------
+#ifdef MY_ASSERT_HAS_POSIX_IO
+namespace my_assert
+{
+namespace detail
+{
+MY_ASSERT_CONSTINIT inline std::atomic<int> g_raw_output_fd{2}; // unbuffered records (MYDEBUG_SIGSAFE, traps)
+
+inline std::size_t write_all(int fd, const char* data, std::size_t size)
+{
+    std::size_t total = 0;
+    while (total < size)
+    {
+        auto written = ::write(fd, data + total, size - total);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        total += static_cast<std::size_t>(written);
+    }
+    return total;
+}
+} // namespace detail
+} // namespace my_assert
+#endif // MY_ASSERT_HAS_POSIX_IO
+
+// ---------------------
+// === Fork handlers ===
+// ---------------------
+// Features with locks or threads set handlers for fork() in a slot. Slots are in lock order: before fork() the
+// prepare handlers take the locks first to last, so the child never inherits one held by a thread that does not
+// exist there; afterwards the parent and child handlers run last to first.
+#ifdef MY_ASSERT_HAS_FORK_HANDLERS
+namespace my_assert
+{
+namespace detail
+{
+enum fork_slot
+{
+    fork_slot_realtime, // the drain thread takes the locks below while holding its own
+    fork_slot_site_rules,
+    fork_slot_lock_graph,
+    fork_slot_async_sink,
+    fork_slot_control_socket,
+    fork_slot_prometheus,
+    fork_slot_graph_writer,
+    fork_slot_check_pools,
+    fork_slot_counters,
+    fork_slot_stats,
+    fork_slot_count
+};
+
+struct fork_handlers
+{
+    std::atomic<void (*)()> prepare{nullptr};
+    std::atomic<void (*)()> parent{nullptr};
+    std::atomic<void (*)()> child{nullptr};
+};
+
+MY_ASSERT_CONSTINIT inline fork_handlers g_fork_handlers[fork_slot_count];
+MY_ASSERT_CONSTINIT inline thread_local unsigned t_prepared_fork_slots = 0; // bit per slot, of the forking thread
+MY_ASSERT_CONSTINIT inline std::atomic<bool> g_reset_stats_on_fork{false};
+
+inline void prepare_fork()
+{
+    t_prepared_fork_slots = 0;
+    for (int slot = 0; slot < fork_slot_count; ++slot)
+    {
+        if (auto* prepare = g_fork_handlers[slot].prepare.load(std::memory_order_acquire))
+        {
+            prepare();
+            t_prepared_fork_slots |= 1u << slot;
+        }
+    }
+}
+
+inline void parent_after_fork()
+{
+    for (int slot = fork_slot_count - 1; slot >= 0; --slot)
+    {
+        auto* parent = g_fork_handlers[slot].parent.load(std::memory_order_acquire);
+        if (parent && (t_prepared_fork_slots & (1u << slot)))
+        {
+            parent();
+        }
+    }
+}
+
+// A slot set up while fork() was being prepared took no locks, and its child handler is skipped.
+inline void child_after_fork()
+{
+    for (int slot = fork_slot_count - 1; slot >= 0; --slot)
+    {
+        auto& handlers = g_fork_handlers[slot];
+        auto* child = handlers.child.load(std::memory_order_acquire);
+        if (child && ((t_prepared_fork_slots & (1u << slot)) || !handlers.prepare.load(std::memory_order_acquire)))
+        {
+            child();
+        }
+    }
+}
+
+// Sets the handlers of a slot (any may be null) and installs the process-wide ones on first use.
+inline void set_fork_handlers(fork_slot slot, void (*prepare)(), void (*parent)(), void (*child)())
+{
+    auto& handlers = g_fork_handlers[slot];
+    handlers.child.store(child, std::memory_order_release);
+    handlers.parent.store(parent, std::memory_order_release);
+    handlers.prepare.store(prepare, std::memory_order_release); // last: a prepared slot has all its handlers
+    MY_ASSERT_CONSTINIT static std::atomic<bool> installed{false};
+    if (!installed.exchange(true, std::memory_order_acq_rel))
+    {
+        ::pthread_atfork(prepare_fork, parent_after_fork, child_after_fork);
+    }
+}
+} // namespace detail
+} // namespace my_assert
+#endif // MY_ASSERT_HAS_FORK_HANDLERS
+
+// --------------
+// === Output ===
+// --------------
+// Records go to stderr, or to the writer set by enable_async_output and enable_file_output (see "Output sinks").
+namespace my_assert
+{
+namespace detail
+{
+MY_ASSERT_CONSTINIT inline std::atomic<bool> g_timestamps{false};
+MY_ASSERT_CONSTINIT inline std::atomic<void (*)(const std::string&, bool)> g_record_writer{nullptr};
+
+// flush: the record reaches the output before the call returns.
+inline void write_record(const std::string& record, bool flush)
+{
+    if (auto* writer = g_record_writer.load(std::memory_order_acquire))
+    {
+        writer(record, flush);
+        return;
+    }
+    std::fwrite(record.data(), 1, record.size(), stderr);
+    if (flush)
+    {
+        std::fflush(stderr);
+    }
+}
+
+// "[seconds.microseconds] " since the Unix epoch, parsed by tools/my_assert_logq.
+inline std::string timestamp_prefix()
+{
+    auto now = std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+                   .count();
+    char prefix[32];
+    std::snprintf(prefix, sizeof(prefix), "[%lld.%06lld] ", static_cast<long long>(now / 1000000),
+                  static_cast<long long>(now % 1000000));
+    return prefix;
+}
+
+// Writes formatted record to the active sink.
+inline void emit(const std::string& record)
+{
+    write_record(g_timestamps.load(std::memory_order_relaxed) ? timestamp_prefix() + record : record, false);
+}
+
+// Writes formatted record of a failure: it must reach the output before the exception is thrown.
+inline void emit_failure(const std::string& record)
+{
+    write_record(g_timestamps.load(std::memory_order_relaxed) ? timestamp_prefix() + record : record, true);
+}
+} // namespace detail
+
+// Prefixes every record with its wall-clock time, which makes logs searchable by time with tools/my_assert_logq.
+inline void enable_timestamps(bool enable = true)
+{
+    detail::g_timestamps.store(enable, std::memory_order_relaxed);
+}
+} // namespace my_assert
+
+// -------------------------------
+// === Block compression (LZ4) ===
+// -------------------------------
+// Streams produced by compressed file output: "MYLZ" magic followed by blocks
+// [raw size: u32 LE][stored size: u32 LE, high bit set if stored uncompressed][data].
+// Block data uses the LZ4 block format, so it can also be decoded by any LZ4 implementation.
+#ifdef MY_ASSERT_ASYNC_OUTPUT
+namespace my_assert
+{
+namespace lz
+{
+constexpr char stream_magic[4] = {'M', 'Y', 'L', 'Z'};
+constexpr std::uint32_t stored_flag = 0x80000000u;
+constexpr std::size_t block_header_size = 8;
+
+constexpr std::size_t compress_bound(std::size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+namespace detail
+{
+constexpr int hash_log = 12;
+constexpr std::size_t min_match = 4;
+constexpr std::size_t last_literals = 5;
+constexpr std::size_t match_search_limit = 12;
+
+inline std::uint32_t read32(const unsigned char* p)
+{
+    std::uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline void write32le(char* p, std::uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        p[i] = static_cast<char>(value >> (8 * i));
+    }
+}
+
+inline std::uint32_t read32le(const char* p)
+{
+    std::uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        value |= static_cast<std::uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    }
+    return value;
+}
+
+inline unsigned char* write_length(unsigned char* op, std::size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        *op++ = 255;
+    }
+    *op++ = static_cast<unsigned char>(length);
+    return op;
+}
+
+inline unsigned char* write_sequence(unsigned char* op, const unsigned char* literals, std::size_t literal_count,
+                                     std::size_t offset, std::size_t match_length)
+{
+    auto* token = op++;
+    *token = static_cast<unsigned char>(std::min<std::size_t>(literal_count, 15) << 4);
+    if (literal_count >= 15)
+    {
+        op = write_length(op, literal_count - 15);
+    }
+    std::memcpy(op, literals, literal_count);
+    op += literal_count;
+    if (match_length == 0)
+    {
+        return op; // last literals
+    }
+    *op++ = static_cast<unsigned char>(offset);
+    *op++ = static_cast<unsigned char>(offset >> 8);
+    match_length -= min_match;
+    *token |= static_cast<unsigned char>(std::min<std::size_t>(match_length, 15));
+    if (match_length >= 15)
+    {
+        op = write_length(op, match_length - 15);
+    }
+    return op;
+}
+} // namespace detail
+
+// Greedy single-pass LZ4 block compressor. dst must hold compress_bound(size) bytes. Returns compressed size.
+inline std::size_t compress_block(const char* src, std::size_t size, char* dst)
+{
+    auto* in = reinterpret_cast<const unsigned char*>(src);
+    auto* op = reinterpret_cast<unsigned char*>(dst);
+    std::size_t anchor = 0;
+    if (size > detail::match_search_limit)
+    {
+        std::uint32_t table[1 << detail::hash_log] = {}; // position + 1, 0 is empty
+        auto match_end_limit = size - detail::last_literals;
+        for (std::size_t ip = 0; ip < size - detail::match_search_limit;)
+        {
+            auto sequence = detail::read32(in + ip);
+            auto hash = (sequence * 2654435761u) >> (32 - detail::hash_log);
+            auto candidate = table[hash];
+            table[hash] = static_cast<std::uint32_t>(ip + 1);
+            if (candidate == 0 || ip - (candidate - 1) > 65535 || detail::read32(in + candidate - 1) != sequence)
+            {
+                ++ip;
+                continue;
+            }
+            auto ref = candidate - 1;
+            auto length = detail::min_match;
+            while (ip + length < match_end_limit && in[ref + length] == in[ip + length])
+            {
+                ++length;
+            }
+            op = detail::write_sequence(op, in + anchor, ip - anchor, ip - ref, length);
+            ip += length;
+            anchor = ip;
+        }
+    }
+    op = detail::write_sequence(op, in + anchor, size - anchor, 0, 0);
+    return static_cast<std::size_t>(op - reinterpret_cast<unsigned char*>(dst));
+}
+
+// Decodes one LZ4 block into dst of exactly raw_size bytes. Returns false on malformed input.
+inline bool decompress_block(const char* src, std::size_t size, char* dst, std::size_t raw_size)
+{
+    auto* ip = reinterpret_cast<const unsigned char*>(src);
+    auto* in_end = ip + size;
+    auto* op = reinterpret_cast<unsigned char*>(dst);
+    auto* out_begin = op;
+    auto* out_end = op + raw_size;
+    auto read_length = [&](std::size_t length) -> std::size_t {
+        if (length != 15)
+        {
+            return length;
+        }
+        unsigned char byte = 255;
+        while (byte == 255 && ip < in_end)
+        {
+            byte = *ip++;
+            length += byte;
+        }
+        return length;
+    };
+    while (ip < in_end)
+    {
+        auto token = *ip++;
+        auto literal_count = read_length(token >> 4);
+        if (literal_count > static_cast<std::size_t>(in_end - ip) ||
+            literal_count > static_cast<std::size_t>(out_end - op))
+        {
+            return false;
+        }
+        std::memcpy(op, ip, literal_count);
+        ip += literal_count;
+        op += literal_count;
+        if (ip == in_end)
+        {
+            break;
+        }
+        if (in_end - ip < 2)
+        {
+            return false;
+        }
+        std::size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        auto match_length = read_length(token & 15) + detail::min_match;
+        if (offset == 0 || offset > static_cast<std::size_t>(op - out_begin) ||
+            match_length > static_cast<std::size_t>(out_end - op))
+        {
+            return false;
+        }
+        for (auto* match = op - offset; match_length > 0; --match_length)
+        {
+            *op++ = *match++; // byte by byte: source and destination may overlap
+        }
+    }
+    return op == out_end;
+}
+
+// Decodes a compressed stream from in_fd to out_fd. Returns false on malformed input.
+inline bool decompress_stream(int in_fd, int out_fd)
+{
+    auto read_exact = [in_fd](char* data, std::size_t size) {
+        std::size_t total = 0;
+        while (total < size)
+        {
+            auto count = ::read(in_fd, data + total, size - total);
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count <= 0)
+            {
+                break;
+            }
+            total += static_cast<std::size_t>(count);
+        }
+        return total;
+    };
+    char magic[sizeof(stream_magic)];
+    if (read_exact(magic, sizeof(magic)) != sizeof(magic) || std::memcmp(magic, stream_magic, sizeof(magic)) != 0)
+    {
+        return false;
+    }
+    std::vector<char> packed;
+    std::vector<char> raw;
+    char header[block_header_size];
+    while (auto header_size = read_exact(header, sizeof(header)))
+    {
+        if (header_size != sizeof(header))
+        {
+            return false;
+        }
+        auto raw_size = detail::read32le(header);
+        auto stored_size = detail::read32le(header + 4);
+        auto stored = (stored_size & stored_flag) != 0;
+        stored_size &= ~stored_flag;
+        packed.resize(stored_size);
+        if (read_exact(packed.data(), stored_size) != stored_size)
+        {
+            return false;
+        }
+        if (stored)
+        {
+            if (stored_size != raw_size)
+            {
+                return false;
+            }
+            raw.swap(packed);
+        }
+        else
+        {
+            raw.resize(raw_size);
+            if (!decompress_block(packed.data(), stored_size, raw.data(), raw_size))
+            {
+                return false;
+            }
+        }
+        if (my_assert::detail::write_all(out_fd, raw.data(), raw.size()) != raw.size())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace lz
+} // namespace my_assert
+#endif // MY_ASSERT_ASYNC_OUTPUT
+
+// --------------------
+// === Output sinks ===
+// --------------------
+#ifdef MY_ASSERT_ASYNC_OUTPUT
+namespace my_assert
+{
+namespace detail
+{
+#    ifdef MY_ASSERT_HAS_IO_URING
+// Minimal io_uring writer over raw syscalls (no liburing dependency).
+// Writes are queued as one chain of linked entries and submitted with a single system call; the kernel runs a chain
+// in order, so records keep their order, and the caller reaps the completions later, while it packs the next buffers.
+class io_uring_writer
+{
+public:
+    io_uring_writer() = default;
+    io_uring_writer(const io_uring_writer&) = delete;
+    io_uring_writer& operator=(const io_uring_writer&) = delete;
+
+    ~io_uring_writer()
+    {
+        close();
+    }
+
+    bool open(int fd, const iovec* buffers, unsigned count)
+    {
+        io_uring_params params{};
+        ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, count, &params));
+        if (ring_fd_ < 0)
+        {
+            return false;
+        }
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        }
+        sq_ptr_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                         IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED)
+        {
+            sq_ptr_ = nullptr;
+            close();
+            return false;
+        }
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            cq_ptr_ = sq_ptr_;
+        }
+        else
+        {
+            cq_ptr_ = ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                             IORING_OFF_CQ_RING);
+            if (cq_ptr_ == MAP_FAILED)
+            {
+                cq_ptr_ = nullptr;
+                close();
+                return false;
+            }
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        auto* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                            IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        auto* sq = static_cast<char*>(sq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        tail_ = *sq_tail_;
+        auto* cq = static_cast<char*>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        if (::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS, buffers, count) < 0)
+        {
+            close();
+            return false;
+        }
+        fd_ = fd;
+        return true;
+    }
+
+    // Queues a write of data, which lies in registered buffer buffer_index, after the writes queued before it.
+    // Returns false if the submission queue is full.
+    bool queue(unsigned buffer_index, const char* data, std::size_t size, std::uint64_t tag)
+    {
+        if (tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_)
+        {
+            return false;
+        }
+        if (queued_ > 0)
+        {
+            sqes_[(tail_ - 1) & sq_mask_].flags |= IOSQE_IO_LINK;
+        }
+        auto index = tail_ & sq_mask_;
+        auto& sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_WRITE_FIXED;
+        sqe.fd = fd_;
+        sqe.addr = reinterpret_cast<std::uint64_t>(data);
+        sqe.len = static_cast<std::uint32_t>(size);
+        sqe.off = static_cast<std::uint64_t>(-1); // current file position
+        sqe.buf_index = static_cast<std::uint16_t>(buffer_index);
+        sqe.user_data = tag;
+        sq_array_[index] = index;
+        ++tail_;
+        ++queued_;
+        return true;
+    }
+
+    // Submits the queued writes with one system call and returns at once, with the number the kernel took.
+    // The others are taken back out of the submission queue (a later call would submit them again) and are left to
+    // the caller.
+    unsigned submit()
+    {
+        auto count = queued_;
+        queued_ = 0;
+        if (count == 0)
+        {
+            return 0;
+        }
+        __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+        int submitted = 0;
+        while ((submitted = enter(count, 0, 0)) < 0 && errno == EINTR)
+        {
+        }
+        auto taken = submitted < 0 ? 0u : static_cast<unsigned>(submitted);
+        if (taken < count)
+        {
+            tail_ -= count - taken;
+            __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+        }
+        return taken;
+    }
+
+    // Waits for the next completion: tag of the write and its result (bytes written or -errno).
+    bool complete(std::uint64_t& tag, int& result)
+    {
+        auto head = *cq_head_;
+        while (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+        {
+            if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            {
+                return false;
+            }
+        }
+        auto& cqe = cqes_[head & cq_mask_];
+        tag = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    void close()
+    {
+        if (sqes_)
+        {
+            ::munmap(sqes_, sqes_size_);
+        }
+        if (cq_ptr_ && cq_ptr_ != sq_ptr_)
+        {
+            ::munmap(cq_ptr_, cq_size_);
+        }
+        if (sq_ptr_)
+        {
+            ::munmap(sq_ptr_, sq_size_);
+        }
+        if (ring_fd_ >= 0)
+        {
+            ::close(ring_fd_);
+        }
+        sqes_ = nullptr;
+        sq_ptr_ = cq_ptr_ = nullptr;
+        ring_fd_ = -1;
+    }
+
+private:
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return static_cast<int>(
+            ::syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    int ring_fd_ = -1;
+    int fd_ = -1;
+    void* sq_ptr_ = nullptr;
+    void* cq_ptr_ = nullptr;
+    std::size_t sq_size_ = 0;
+    std::size_t cq_size_ = 0;
+    std::size_t sqes_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned tail_ = 0;   // queued entries are published to the kernel by submit()
+    unsigned queued_ = 0; // entries queued since the last submit()
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+};
+#    endif // MY_ASSERT_HAS_IO_URING
+
+// Buffered sink with a background flusher thread.
+// Callers only copy the record into one of the preallocated buffers; full buffers are written by the flusher
+// through io_uring (registered buffers) when available, or through write(2) otherwise. The flusher takes all full
+// buffers at once: with io_uring it submits them in one call and, while they are written, packs or collects the next.
+// With compression, the flusher also packs each buffer into an lz block, so callers never pay for it.
+class async_sink
+{
+public:
+    static constexpr std::size_t buffer_size = 64 * 1024;
+    static constexpr unsigned buffer_count = 4;
+    static constexpr std::size_t packed_size = lz::block_header_size + lz::compress_bound(buffer_size);
+
+    // continue_stream: the compressed stream header was already written to fd (sink restarted after fork).
+    explicit async_sink(int fd, bool compress = false, bool continue_stream = false)
+        : fd_(fd), compress_(compress),
+          storage_(buffer_size * buffer_count + (compress ? packed_size * buffer_count : 0))
+    {
+        for (unsigned i = 1; i < buffer_count; ++i)
+        {
+            free_.push_back(i);
+        }
+        if (compress_ && !continue_stream)
+        {
+            write_all(fd_, lz::stream_magic, sizeof(lz::stream_magic));
+        }
+#    ifdef MY_ASSERT_HAS_IO_URING
+        iovec buffers[2 * buffer_count];
+        auto count = compress_ ? 2 * buffer_count : buffer_count;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            buffers[i] = iovec{buffer(i), i < buffer_count ? buffer_size : packed_size};
+        }
+        use_io_uring_ = io_uring_.open(fd_, buffers, count);
+#    endif
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~async_sink()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        flusher_cv_.notify_one();
+        thread_.join();
+    }
+
+    async_sink(const async_sink&) = delete;
+    async_sink& operator=(const async_sink&) = delete;
+
+    bool uses_io_uring() const
+    {
+        return use_io_uring_;
+    }
+
+    void write(const char* data, std::size_t size)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (size <= buffer_size && current_size_ + size > buffer_size)
+        {
+            submit_current_locked(lock);
+        }
+        // Oversized records are split between buffers, so compressed streams stay consistent.
+        while (size > 0)
+        {
+            if (current_size_ == buffer_size)
+            {
+                submit_current_locked(lock);
+            }
+            auto chunk = std::min(size, buffer_size - current_size_);
+            std::memcpy(buffer(current_) + current_size_, data, chunk);
+            current_size_ += chunk;
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+    // Waits until all records written so far reach the file descriptor.
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        flush_locked(lock);
+    }
+
+    int fd() const
+    {
+        return fd_;
+    }
+
+    bool compressed() const
+    {
+        return compress_;
+    }
+
+    // Before fork(): writes everything out and keeps the sink locked, so the child gets empty buffers.
+    void lock_for_fork()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        flush_locked(lock);
+        lock.release();
+    }
+
+    void unlock_after_fork()
+    {
+        mutex_.unlock();
+    }
+
+    // In the child the flusher thread does not exist: releases the ring and buffers, the object itself is leaked.
+    void abandon_in_child()
+    {
+        mutex_.unlock();
+#    ifdef MY_ASSERT_HAS_IO_URING
+        io_uring_.close();
+        use_io_uring_ = false;
+#    endif
+        std::vector<char>().swap(storage_);
+    }
+
+private:
+    // A full buffer on its way to the file descriptor.
+    struct pending_write
+    {
+        unsigned index;       // buffer of the records
+        unsigned write_index; // buffer written out: the same, or its packed block
+        std::size_t size;     // bytes of write_index
+        std::size_t written;
+        bool submitted;
+    };
+
+    // Buffers 0..buffer_count-1 collect records, buffer_count+i holds the packed block of buffer i.
+    char* buffer(unsigned index)
+    {
+        return index < buffer_count ? storage_.data() + index * buffer_size
+                                    : storage_.data() + buffer_count * buffer_size +
+                                          (index - buffer_count) * packed_size;
+    }
+
+    void submit_current_locked(std::unique_lock<std::mutex>& lock)
+    {
+        producer_cv_.wait(lock, [this] { return !free_.empty(); });
+        ready_.push_back({current_, current_size_});
+        ++submitted_;
+        current_ = free_.back();
+        free_.pop_back();
+        current_size_ = 0;
+        flusher_cv_.notify_one();
+    }
+
+    void flush_locked(std::unique_lock<std::mutex>& lock)
+    {
+        if (current_size_ > 0)
+        {
+            submit_current_locked(lock);
+        }
+        auto target = submitted_;
+        producer_cv_.wait(lock, [this, target] { return completed_ >= target; });
+    }
+
+    void run()
+    {
+        std::vector<std::pair<unsigned, std::size_t>> taken;
+        std::vector<pending_write> batch;
+        std::vector<pending_write> in_flight;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            if (in_flight.empty())
+            {
+                flusher_cv_.wait_for(lock, std::chrono::milliseconds(10),
+                                     [this] { return stop_ || !ready_.empty(); });
+                if (ready_.empty() && current_size_ > 0 && !free_.empty())
+                {
+                    submit_current_locked(lock);
+                }
+            }
+            taken.swap(ready_);
+            if (taken.empty() && in_flight.empty())
+            {
+                if (stop_)
+                {
+                    return;
+                }
+                continue;
+            }
+            lock.unlock();
+            for (auto [index, size] : taken)
+            {
+                if (compress_)
+                {
+                    batch.push_back({index, buffer_count + index, pack(index, size), 0, false});
+                }
+                else
+                {
+                    batch.push_back({index, index, size, 0, false});
+                }
+            }
+            taken.clear();
+            finish(in_flight);
+            if (!in_flight.empty())
+            {
+                lock.lock();
+                for (auto& write : in_flight)
+                {
+                    free_.push_back(write.index);
+                }
+                completed_ += in_flight.size();
+                lock.unlock();
+                producer_cv_.notify_all();
+                in_flight.clear();
+            }
+            start(batch);
+            in_flight.swap(batch);
+            lock.lock();
+        }
+    }
+
+    // Submits the batch (with io_uring) without waiting for it.
+    void start(std::vector<pending_write>& batch)
+    {
+#    ifdef MY_ASSERT_HAS_IO_URING
+        if (!use_io_uring_ || batch.empty())
+        {
+            return;
+        }
+        unsigned queued = 0;
+        while (queued < batch.size() && io_uring_.queue(batch[queued].write_index, buffer(batch[queued].write_index),
+                                                        batch[queued].size, queued))
+        {
+            ++queued;
+        }
+        auto submitted = io_uring_.submit();
+        for (unsigned i = 0; i < submitted; ++i)
+        {
+            batch[i].submitted = true;
+        }
+#    else
+        (void)batch;
+#    endif
+    }
+
+    // Reaps the completions of a started batch, then writes whatever was not written, in order, with write(2).
+    // A short or failed write cancels the rest of its chain, so the writes after it are all still to do.
+    void finish(std::vector<pending_write>& batch)
+    {
+#    ifdef MY_ASSERT_HAS_IO_URING
+        for (auto& write : batch)
+        {
+            if (!write.submitted)
+            {
+                break;
+            }
+            std::uint64_t tag = 0;
+            auto result = 0;
+            if (!io_uring_.complete(tag, result))
+            {
+                use_io_uring_ = false;
+                break;
+            }
+            if (tag < batch.size() && result > 0)
+            {
+                batch[tag].written = static_cast<std::size_t>(result);
+            }
+        }
+#    endif
+        for (auto& write : batch)
+        {
+            write_all(fd_, buffer(write.write_index) + write.written, write.size - write.written);
+        }
+    }
+
+    // Compresses buffer into its packed buffer, returns the size of the block.
+    std::size_t pack(unsigned index, std::size_t size)
+    {
+        auto* block = buffer(buffer_count + index);
+        auto packed = lz::compress_block(buffer(index), size, block + lz::block_header_size);
+        auto stored_size = static_cast<std::uint32_t>(packed);
+        if (packed >= size)
+        {
+            std::memcpy(block + lz::block_header_size, buffer(index), size);
+            packed = size;
+            stored_size = static_cast<std::uint32_t>(size) | lz::stored_flag;
+        }
+        lz::detail::write32le(block, static_cast<std::uint32_t>(size));
+        lz::detail::write32le(block + 4, stored_size);
+        return lz::block_header_size + packed;
+    }
+
+    int fd_;
+    bool compress_;
+    std::vector<char> storage_;
+    std::mutex mutex_;
+    std::condition_variable producer_cv_;
+    std::condition_variable flusher_cv_;
+    std::vector<unsigned> free_;
+    std::vector<std::pair<unsigned, std::size_t>> ready_;
+    unsigned current_ = 0;
+    std::size_t current_size_ = 0;
+    std::uint64_t submitted_ = 0;
+    std::uint64_t completed_ = 0;
+    bool stop_ = false;
+    bool use_io_uring_ = false;
+#    ifdef MY_ASSERT_HAS_IO_URING
+    io_uring_writer io_uring_;
+#    endif
+    std::thread thread_;
+};
+
+MY_ASSERT_CONSTINIT inline std::atomic<async_sink*> g_async_sink{nullptr};
+MY_ASSERT_CONSTINIT inline std::atomic<int> g_async_sink_users{0}; // threads inside async_sink_ref
+MY_ASSERT_CONSTINIT inline std::atomic<int> g_async_restart_fd{-1}; // set in a forked child
+MY_ASSERT_CONSTINIT inline std::atomic<bool> g_async_sink_claimed{false}; // by the first enable call, for good
+MY_ASSERT_CONSTINIT inline std::atomic<bool> g_async_restart_compress{false};
+
+// Use of the sink by one writer: stop_async_sink waits until every writer that saw the sink is done with it.
+// Only atomic operations, so it may be taken in a signal handler.
+class async_sink_ref
+{
+public:
+    async_sink_ref()
+    {
+        g_async_sink_users.fetch_add(1, std::memory_order_seq_cst);
+        sink_ = g_async_sink.load(std::memory_order_seq_cst);
+    }
+
+    ~async_sink_ref()
+    {
+        g_async_sink_users.fetch_sub(1, std::memory_order_release);
+    }
+
+    async_sink_ref(const async_sink_ref&) = delete;
+    async_sink_ref& operator=(const async_sink_ref&) = delete;
+
+    async_sink* get() const
+    {
+        return sink_;
+    }
+
+    void reset(async_sink* sink)
+    {
+        sink_ = sink;
+    }
+
+private:
+    async_sink* sink_;
+};
+
+// At exit: writers arriving later find no sink and write to stderr; the ones already using it are waited for.
+inline void stop_async_sink()
+{
+    auto* sink = g_async_sink.exchange(nullptr, std::memory_order_seq_cst);
+    if (!sink)
+    {
+        return;
+    }
+    g_raw_output_fd.store(2, std::memory_order_relaxed);
+    while (g_async_sink_users.load(std::memory_order_seq_cst) != 0)
+    {
+        std::this_thread::yield();
+    }
+    delete sink;
+}
+
+// First record in a forked child: starts a new flusher thread on the inherited descriptor.
+[[gnu::noinline, gnu::cold]] inline async_sink* restart_async_sink()
+{
+    auto fd = g_async_restart_fd.exchange(-1, std::memory_order_acq_rel);
+    if (fd >= 0)
+    {
+        auto compress = g_async_restart_compress.load(std::memory_order_relaxed);
+        g_async_sink.store(new async_sink(fd, compress, true), std::memory_order_release);
+    }
+    return g_async_sink.load(std::memory_order_acquire);
+}
+
+// Record writer while async output is enabled.
+inline void write_async_record(const std::string& record, bool flush)
+{
+    async_sink_ref ref;
+    auto* sink = ref.get();
+    if (!sink && __builtin_expect(g_async_restart_fd.load(std::memory_order_relaxed) >= 0, 0))
+    {
+        sink = restart_async_sink();
+        ref.reset(sink);
+    }
+    if (sink)
+    {
+        sink->write(record.data(), record.size());
+        if (flush)
+        {
+            sink->flush();
+        }
+        return;
+    }
+    write_all(2, record.data(), record.size());
+}
+
+// Before fork() the sink is flushed and stays locked, so the child gets empty buffers.
+inline void lock_async_sink_for_fork()
+{
+    if (auto* sink = g_async_sink.load(std::memory_order_acquire))
+    {
+        sink->lock_for_fork();
+    }
+}
+
+inline void unlock_async_sink_after_fork()
+{
+    if (auto* sink = g_async_sink.load(std::memory_order_acquire))
+    {
+        sink->unlock_after_fork();
+    }
+}
+
+// The flusher thread is not in the child: the sink restarts on the first record.
+inline void abandon_async_sink_in_child()
+{
+    if (auto* sink = g_async_sink.exchange(nullptr, std::memory_order_acq_rel))
+    {
+        g_async_restart_compress.store(sink->compressed(), std::memory_order_relaxed);
+        g_async_restart_fd.store(sink->fd(), std::memory_order_release);
+        sink->abandon_in_child();
+    }
+    g_async_sink_users.store(0, std::memory_order_relaxed); // writers interrupted by fork() are not in the child
+}
+
+// Reserves the sink for one caller, before it opens its file: later calls neither truncate a file nor start a
+// second sink.
+inline bool claim_async_sink()
+{
+    return !g_async_sink_claimed.exchange(true, std::memory_order_acq_rel);
+}
+
+// Starts the sink claimed by the caller.
+inline void start_async_sink(int fd, bool compress)
+{
+    g_async_sink.store(new async_sink(fd, compress), std::memory_order_release);
+    if (!compress)
+    {
+        g_raw_output_fd.store(fd, std::memory_order_relaxed);
+    }
+    g_record_writer.store(write_async_record, std::memory_order_release);
+    std::atexit(stop_async_sink);
+    set_fork_handlers(fork_slot_async_sink, lock_async_sink_for_fork, unlock_async_sink_after_fork,
+                      abandon_async_sink_in_child);
+}
+} // namespace detail
+
+// Routes all output through a buffered background sink writing to fd (io_uring if available, write(2) otherwise).
+// Assertion failures are still flushed synchronously. Call once, before starting worker threads.
+// Returns false if output was already enabled.
+inline bool enable_async_output(int fd = 2)
+{
+    if (!detail::claim_async_sink())
+    {
+        return false;
+    }
+    detail::start_async_sink(fd, false);
+    return true;
+}
+
+// Same as enable_async_output, but writes to a file, optionally compressed on the flusher thread.
+// Compressed logs are decoded by tools/my_assert_unlz. Returns false if output was already enabled (the file is
+// left untouched) or if the file cannot be opened.
+inline bool enable_file_output(const char* path, bool compress = false)
+{
+    if (!detail::claim_async_sink())
+    {
+        return false;
+    }
+    auto fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        detail::g_async_sink_claimed.store(false, std::memory_order_release);
+        return false;
+    }
+    detail::start_async_sink(fd, compress);
+    return true;
+}
+} // namespace my_assert
+#endif // MY_ASSERT_ASYNC_OUTPUT
+
+// ------------------------
+// === Enum value names ===
+// ------------------------
+// Enumerators are printed by name. Names are found at compile time by instantiating a probe for every value of
+// [MY_ASSERT_ENUM_MIN, MY_ASSERT_ENUM_MAX] and parsing its __PRETTY_FUNCTION__; lookup indexes the resulting table.
+// Values outside the range, flag combinations and values without an enumerator are printed as integers.
+#ifndef MY_ASSERT_ENUM_MIN
+#    define MY_ASSERT_ENUM_MIN -128
+#endif
+#ifndef MY_ASSERT_ENUM_MAX
+#    define MY_ASSERT_ENUM_MAX 127
+#endif
+
+namespace my_assert
+{
+namespace detail
+{
+template <typename E, E V>
+constexpr std::string_view enum_value_probe()
+{
+    return __PRETTY_FUNCTION__;
+}
+
+// "... E V = ns::Color::red; ..." (GCC) or "...V = ns::Color::red]" (Clang); "(ns::Color)5" or "5" when no
+// enumerator has the value.
+constexpr std::string_view enum_name_from_probe(std::string_view probe)
+{
+    probe = probe.substr(probe.find(" V = ") + 5);
+    probe = probe.substr(0, probe.find_first_of(";]"));
+    if (probe.empty() || probe[0] == '(' || probe[0] == '-' || (probe[0] >= '0' && probe[0] <= '9'))
+    {
+        return {};
+    }
+    return probe.substr(probe.find_last_of(':') + 1);
+}
+
+// Probed range clamped to the values representable by the underlying type.
+template <typename E>
+constexpr long long enum_probe_min()
+{
+    using underlying = std::underlying_type_t<E>;
+    if constexpr (std::is_signed_v<underlying>)
+    {
+        return std::max<long long>(MY_ASSERT_ENUM_MIN, std::numeric_limits<underlying>::min());
+    }
+    else
+    {
+        return std::max<long long>(MY_ASSERT_ENUM_MIN, 0);
+    }
+}
+
+template <typename E>
+constexpr long long enum_probe_max()
+{
+    using underlying = std::underlying_type_t<E>;
+    constexpr auto limit = static_cast<unsigned long long>(std::numeric_limits<underlying>::max());
+    return limit < static_cast<unsigned long long>(MY_ASSERT_ENUM_MAX) ? static_cast<long long>(limit)
+                                                                        : MY_ASSERT_ENUM_MAX;
+}
+
+template <typename E, std::size_t... I>
+constexpr std::array<std::string_view, sizeof...(I)> enum_name_table(std::index_sequence<I...>)
+{
+    return {{enum_name_from_probe(
+        enum_value_probe<E, static_cast<E>(enum_probe_min<E>() + static_cast<long long>(I))>())...}};
+}
+
+template <typename E>
+constexpr std::size_t enum_probe_count = static_cast<std::size_t>(enum_probe_max<E>() - enum_probe_min<E>() + 1);
+
+template <typename E>
+inline constexpr auto enum_names = enum_name_table<E>(std::make_index_sequence<enum_probe_count<E>>{});
+
+// Name of the enumerator with this value, empty if there is none (or it is outside the probed range).
+template <typename E>
+constexpr std::string_view enum_name(E value)
+{
+    auto index = static_cast<long long>(value) - enum_probe_min<E>();
+    if (index < 0 || index > enum_probe_max<E>() - enum_probe_min<E>())
+    {
+        return {};
+    }
+    return enum_names<E>[static_cast<std::size_t>(index)];
+}
+} // namespace detail
+} // namespace my_assert
+
+// ------------------------------
+// === Printing of aggregates ===
+// ------------------------------
+// MYDEBUG prints values with operator<<; aggregates without one are printed field by field (structured bindings,
+// field names with C++20), ranges and arrays element by element. Aggregates with base classes or array members are
+// refused: brace elision makes their initializer count differ from the number of names a binding needs.
+namespace my_assert
+{
+namespace detail
+{
+// Converts to anything: counts the initializers an aggregate accepts.
+struct any_field
+{
+    template <typename T>
+    constexpr operator T() const noexcept;
+};
+
+template <typename T, typename Indices, typename = void>
+struct accepts_fields : std::false_type
+{
+};
+
+template <typename T, std::size_t... I>
+struct accepts_fields<T, std::index_sequence<I...>, std::void_t<decltype(T{(void(I), any_field{})...})>>
+    : std::true_type
+{
+};
+
+// Each initializer in braces initializes exactly one member: no brace elision into array members.
+template <typename T, typename Indices, typename = void>
+struct accepts_braced_fields : std::false_type
+{
+};
+
+template <typename T, std::size_t... I>
+struct accepts_braced_fields<T, std::index_sequence<I...>, std::void_t<decltype(T{{(void(I), any_field{})}...})>>
+    : std::true_type
+{
+};
+
+// Converts only to base classes of T: T{any_base<T>{}} is valid when T has a base.
+template <typename T>
+struct any_base
+{
+    template <typename U, typename = std::enable_if_t<std::is_base_of_v<U, T> && !std::is_same_v<U, T>>>
+    constexpr operator U() const noexcept;
+};
+
+template <typename T, typename = void>
+struct has_base : std::false_type
+{
+};
+
+template <typename T>
+struct has_base<T, std::void_t<decltype(T{any_base<T>{}})>> : std::true_type
+{
+};
+
+constexpr std::size_t max_printed_fields = 16;
+
+// Initializers T accepts, counting up to one past max_printed_fields.
+template <typename T, template <typename, typename, typename> class Accepts, std::size_t N = 0>
+constexpr std::size_t initializer_count()
+{
+    if constexpr (N <= max_printed_fields && Accepts<T, std::make_index_sequence<N + 1>, void>::value)
+    {
+        return initializer_count<T, Accepts, N + 1>();
+    }
+    else
+    {
+        return N;
+    }
+}
+
+template <typename T>
+constexpr std::size_t field_count()
+{
+    return initializer_count<T, accepts_fields>();
+}
+
+// Whether structured bindings of field_count() names decompose T: an array member takes several initializers
+// (brace elision) but one name, and fields of a base class cannot be bound together with those of T.
+template <typename T>
+constexpr bool prints_fields()
+{
+    if constexpr (std::is_aggregate_v<T> && !has_base<T>::value)
+    {
+        constexpr auto count = field_count<T>();
+        return count > 0 && count <= max_printed_fields && initializer_count<T, accepts_braced_fields>() == count;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+#define MY_ASSERT_TIE_FIELDS(n, ...)                                                                                   \
+    if constexpr (count == n)                                                                                          \
+    {                                                                                                                  \
+        auto& [__VA_ARGS__] = value;                                                                                   \
+        return std::tie(__VA_ARGS__);                                                                                  \
+    }                                                                                                                  \
+    else
+
+// Tuple of references to the fields of an aggregate.
+template <typename T>
+constexpr auto tie_fields(T& value)
+{
+    constexpr auto count = field_count<std::remove_const_t<T>>();
+    MY_ASSERT_TIE_FIELDS(1, a)
+    MY_ASSERT_TIE_FIELDS(2, a, b)
+    MY_ASSERT_TIE_FIELDS(3, a, b, c)
+    MY_ASSERT_TIE_FIELDS(4, a, b, c, d)
+    MY_ASSERT_TIE_FIELDS(5, a, b, c, d, e)
+    MY_ASSERT_TIE_FIELDS(6, a, b, c, d, e, f)
+    MY_ASSERT_TIE_FIELDS(7, a, b, c, d, e, f, g)
+    MY_ASSERT_TIE_FIELDS(8, a, b, c, d, e, f, g, h)
+    MY_ASSERT_TIE_FIELDS(9, a, b, c, d, e, f, g, h, i)
+    MY_ASSERT_TIE_FIELDS(10, a, b, c, d, e, f, g, h, i, j)
+    MY_ASSERT_TIE_FIELDS(11, a, b, c, d, e, f, g, h, i, j, k)
+    MY_ASSERT_TIE_FIELDS(12, a, b, c, d, e, f, g, h, i, j, k, l)
+    MY_ASSERT_TIE_FIELDS(13, a, b, c, d, e, f, g, h, i, j, k, l, m)
+    MY_ASSERT_TIE_FIELDS(14, a, b, c, d, e, f, g, h, i, j, k, l, m, n)
+    MY_ASSERT_TIE_FIELDS(15, a, b, c, d, e, f, g, h, i, j, k, l, m, n, o)
+    MY_ASSERT_TIE_FIELDS(16, a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)
+    {
+        return std::tie();
+    }
+}
+#undef MY_ASSERT_TIE_FIELDS
+
+#if __cplusplus >= 202002L
+template <typename T>
+struct fake_object_holder
+{
+    const T value;
+};
+
+// Never defined: only addresses of its fields are used, in constant expressions.
+template <typename T>
+extern const fake_object_holder<T> fake_object;
+
+template <auto Pointer>
+constexpr std::string_view pointer_name_probe()
+{
+    return __PRETTY_FUNCTION__;
+}
+
+// "... Pointer = (& fake_object<S>.fake_object_holder<S>::value.S::name) ..." (GCC) or "...value.name]" (Clang).
+constexpr std::string_view field_name_from_probe(std::string_view probe)
+{
+    probe = probe.substr(probe.find("Pointer = "));
+    probe = probe.substr(0, probe.find_first_of(");]"));
+    return probe.substr(probe.find_last_of(":.") + 1);
+}
+
+// A variable, so the name is always a constant: fake_object is never referenced at run time, even at -O0.
+template <typename T, std::size_t I>
+inline constexpr std::string_view field_name =
+    field_name_from_probe(pointer_name_probe<&std::get<I>(tie_fields(fake_object<T>.value))>());
+#endif
+
+template <typename T, typename = void>
+struct has_ostream_operator : std::false_type
+{
+};
+
+template <typename T>
+struct has_ostream_operator<T, std::void_t<decltype(std::declval<std::ostream&>() << std::declval<const T&>())>>
+    : std::true_type
+{
+};
+
+template <typename T, typename = void>
+struct is_range : std::false_type
+{
+};
+
+template <typename T>
+struct is_range<T, std::void_t<decltype(std::begin(std::declval<const T&>()), std::end(std::declval<const T&>()))>>
+    : std::true_type
+{
+};
+
+// An unscoped enum always has an operator<< through the conversion to int. The probe is an exact match for any
+// enum, so it loses only to an operator<< taking the enum itself: a non-template one wins over the probe, a
+// template one is ambiguous with it; the conversion to int (a promotion) is a worse match than both.
+namespace enum_operator_probe
+{
+struct no_operator
+{
+};
+
+template <typename E, typename = std::enable_if_t<std::is_enum_v<E>>>
+no_operator operator<<(std::ostream& os, const E& value);
+
+template <typename E>
+using insertion_result = decltype(std::declval<std::ostream&>() << std::declval<const E&>());
+
+template <typename E, typename = void>
+struct has_own_operator : std::true_type
+{
+};
+
+template <typename E>
+struct has_own_operator<E, std::enable_if_t<std::is_same_v<insertion_result<E>, no_operator>>> : std::false_type
+{
+};
+} // namespace enum_operator_probe
+
+// Enums are printed by name unless they have their own operator<<.
+template <typename T>
+constexpr bool prints_enum_name()
+{
+    if constexpr (std::is_enum_v<T>)
+    {
+        return !enum_operator_probe::has_own_operator<T>::value;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+// Arrays would decay to pointers in operator<<: only character arrays are printed with it, as strings.
+template <typename T>
+constexpr bool prints_with_operator()
+{
+    if constexpr (std::is_array_v<T>)
+    {
+        return std::is_same_v<std::remove_cv_t<std::remove_extent_t<T>>, char>;
+    }
+    else
+    {
+        return has_ostream_operator<T>::value;
+    }
+}
+
+template <typename T>
+void print_value(std::ostream& os, const T& value);
+
+template <typename T, std::size_t... I>
+void print_fields(std::ostream& os, const T& value, std::index_sequence<I...>)
+{
+    auto fields = tie_fields(value);
+    os << "{";
+#if __cplusplus >= 202002L
+    ((os << (I ? ", " : "") << field_name<T, I> << " = ", print_value(os, std::get<I>(fields))), ...);
+#else
+    ((os << (I ? ", " : ""), print_value(os, std::get<I>(fields))), ...);
+#endif
+    os << "}";
+}
+
+template <typename T>
+void print_value(std::ostream& os, const T& value)
+{
+    if constexpr (prints_enum_name<T>())
+    {
+        auto name = enum_name(value);
+        if (!name.empty())
+        {
+            os << name;
+        }
+        else
+        {
+            os << +static_cast<std::underlying_type_t<T>>(value);
+        }
+    }
+    else if constexpr (prints_with_operator<T>())
+    {
+        os << value;
+    }
+    else if constexpr (is_range<T>::value)
+    {
+        os << "[";
+        auto first = true;
+        for (const auto& element : value)
+        {
+            os << (first ? "" : ", ");
+            print_value(os, element);
+            first = false;
+        }
+        os << "]";
+    }
+    else if constexpr (prints_fields<T>())
+    {
+        print_fields(os, value, std::make_index_sequence<field_count<T>()>{});
+    }
+    else
+    {
+        static_assert(!std::is_aggregate_v<T> || (!has_base<T>::value && field_count<T>() == 0),
+                      "MYDEBUG prints aggregates field by field only without base classes, array members or more "
+                      "than 16 fields: define operator<< for this type");
+        os << value; // no way to print T: the usual operator<< error
+    }
+}
+
+template <typename T>
+struct printable_value
+{
+    const T& value;
+};
+
+template <typename T>
+printable_value<T> printable(const T& value)
+{
+    return {value};
+}
+
+template <typename T>
+std::ostream& operator<<(std::ostream& os, printable_value<T> printable)
+{
+    print_value(os, printable.value);
+    return os;
+}
+} // namespace detail
+} // namespace my_assert
+
+// -------------------------
+// === Printing of grids ===
+// -------------------------
+// MYDEBUG_GRID prints a 2D table (DP tables, mazes) as aligned columns with row and column indices. The record is
+// formatted into one buffer (numbers with std::to_chars) and written at once; large grids are truncated to
+// MY_ASSERT_GRID_MAX_ROWS x MY_ASSERT_GRID_MAX_COLS.
+#ifdef MY_ASSERT_GRIDS
+#    ifndef MY_ASSERT_GRID_MAX_ROWS
+#        define MY_ASSERT_GRID_MAX_ROWS 32
+#    endif
+#    ifndef MY_ASSERT_GRID_MAX_COLS
+#        define MY_ASSERT_GRID_MAX_COLS 24
+#    endif
+
+namespace my_assert
+{
+namespace detail
+{
+template <typename T>
+void append_cell(std::string& out, const T& value)
+{
+    if constexpr (std::is_same_v<T, bool>)
+    {
+        out += value ? '1' : '0';
+    }
+    else if constexpr (std::is_same_v<T, char>)
+    {
+        out += value;
+    }
+    else if constexpr (std::is_integral_v<T> || std::is_floating_point_v<T>)
+    {
+        char buffer[64];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+    else
+    {
+        std::ostringstream oss;
+        print_value(oss, value);
+        out += oss.str();
+    }
+}
+
+// rows x cols cells; append(out, i, j) formats cell (i, j), appending nothing for a missing one.
+template <typename Append>
+struct grid_ref
+{
+    std::size_t rows;
+    std::size_t cols;
+    Append append;
+};
+
+template <typename Append>
+grid_ref<Append> make_grid(std::size_t rows, std::size_t cols, Append append)
+{
+    return {rows, cols, append};
+}
+
+// MYDEBUG_GRID(ptr, rows, cols): row-major data, or a pointer to rows of a 2D array.
+template <typename Pointer>
+auto grid_of(Pointer data, std::size_t rows, std::size_t cols)
+{
+    return make_grid(rows, cols, [data, cols](std::string& out, std::size_t i, std::size_t j) {
+        if constexpr (std::is_array_v<std::remove_pointer_t<Pointer>>)
+        {
+            append_cell(out, data[i][j]);
+        }
+        else
+        {
+            append_cell(out, data[i * cols + j]);
+        }
+    });
+}
+
+template <typename T, typename = void>
+struct is_mdspan_like : std::false_type
+{
+};
+
+template <typename T>
+struct is_mdspan_like<T, std::void_t<decltype(T::rank(), std::declval<const T&>().extent(0))>> : std::true_type
+{
+};
+
+template <typename T, typename = void>
+struct has_call_operator_2d : std::false_type
+{
+};
+
+template <typename T>
+struct has_call_operator_2d<T, std::void_t<decltype(std::declval<const T&>()(std::size_t{}, std::size_t{}))>>
+    : std::true_type
+{
+};
+
+// MYDEBUG_GRID(grid): std::mdspan-like views of rank 2, 2D arrays and containers of rows (rows may differ in size).
+template <typename Grid>
+auto grid_of(const Grid& grid)
+{
+    if constexpr (is_mdspan_like<Grid>::value)
+    {
+        static_assert(Grid::rank() == 2, "MYDEBUG_GRID needs a view of rank 2");
+        return make_grid(grid.extent(0), grid.extent(1), [&grid](std::string& out, std::size_t i, std::size_t j) {
+            using index = typename Grid::index_type;
+            if constexpr (has_call_operator_2d<Grid>::value)
+            {
+                append_cell(out, grid(static_cast<index>(i), static_cast<index>(j)));
+            }
+            else
+            {
+                append_cell(out, grid[std::array<index, 2>{static_cast<index>(i), static_cast<index>(j)}]);
+            }
+        });
+    }
+    else
+    {
+        std::size_t cols = 0;
+        for (const auto& row : grid)
+        {
+            cols = std::max<std::size_t>(cols, std::size(row));
+        }
+        return make_grid(std::size(grid), cols, [&grid](std::string& out, std::size_t i, std::size_t j) {
+            const auto& row = grid[i];
+            if (j < std::size(row))
+            {
+                append_cell(out, row[j]);
+            }
+        });
+    }
+}
+
+struct no_highlight
+{
+    int operator()(std::size_t, std::size_t) const
+    {
+        return 0;
+    }
+};
+
+// Color code of a cell: highlight(i, j) returns a *_FG_CODE, or true for GREEN_FG_CODE; 0 or false for none.
+template <typename Highlight>
+int cell_color(Highlight& highlight, std::size_t i, std::size_t j)
+{
+    auto color = highlight(i, j);
+    if constexpr (std::is_same_v<decltype(color), bool>)
+    {
+        return color ? GREEN_FG_CODE : 0;
+    }
+    else
+    {
+        return static_cast<int>(color);
+    }
+}
+
+inline void append_padded(std::string& out, std::string_view text, std::size_t width, int color)
+{
+    out.append(width > text.size() ? width - text.size() : 0, ' ');
+    if (color)
+    {
+        out += "\033[1;";
+        append_cell(out, color);
+        out += 'm';
+    }
+    out += text;
+    if (color)
+    {
+        out += FORMAT_END;
+    }
+}
+
+template <typename Append, typename Highlight>
+std::string format_grid(const char* prefix, const grid_ref<Append>& grid, Highlight highlight)
+{
+    auto rows = std::min<std::size_t>(grid.rows, MY_ASSERT_GRID_MAX_ROWS);
+    auto cols = std::min<std::size_t>(grid.cols, MY_ASSERT_GRID_MAX_COLS);
+
+    // Cells are formatted once into one buffer; ends[k] closes cell k (row-major).
+    std::string cells;
+    std::vector<std::size_t> ends(rows * cols);
+    std::vector<std::size_t> widths(cols);
+    for (std::size_t i = 0; i < rows; ++i)
+    {
+        for (std::size_t j = 0; j < cols; ++j)
+        {
+            auto begin = cells.size();
+            grid.append(cells, i, j);
+            ends[i * cols + j] = cells.size();
+            widths[j] = std::max(widths[j], cells.size() - begin);
+        }
+    }
+    std::string index;
+    auto index_width = [&index](std::size_t value) {
+        index.clear();
+        append_cell(index, value);
+        return index.size();
+    };
+    for (std::size_t j = 0; j < cols; ++j)
+    {
+        widths[j] = std::max(widths[j], index_width(j));
+    }
+    auto row_width = rows ? index_width(rows - 1) : 1;
+
+    std::string out = prefix;
+    out += " (";
+    append_cell(out, grid.rows);
+    out += " x ";
+    append_cell(out, grid.cols);
+    out += ")";
+    out.reserve(out.size() + (rows + 2) * (row_width + 3 + cols * 8) + cells.size());
+    out += "\n";
+    out.append(row_width + 1, ' ');
+    for (std::size_t j = 0; j < cols; ++j)
+    {
+        index_width(j);
+        out += ' ';
+        append_padded(out, index, widths[j], 0);
+    }
+    out += cols < grid.cols ? " ...\n" : "\n";
+    std::size_t begin = 0;
+    for (std::size_t i = 0; i < rows; ++i)
+    {
+        index_width(i);
+        append_padded(out, index, row_width, 0);
+        out += ':';
+        for (std::size_t j = 0; j < cols; ++j)
+        {
+            auto end = ends[i * cols + j];
+            out += ' ';
+            auto text = std::string_view(cells).substr(begin, end - begin);
+            append_padded(out, text, widths[j], cell_color(highlight, i, j));
+            begin = end;
+        }
+        out += cols < grid.cols ? " ...\n" : "\n";
+    }
+    if (rows < grid.rows)
+    {
+        out += "... ";
+        append_cell(out, grid.rows - rows);
+        out += " more rows\n";
+    }
+    return out;
+}
+} // namespace detail
+} // namespace my_assert
+#endif // MY_ASSERT_GRIDS
+
+// ----------------------------------------
+// === Async-signal-safe debug printing ===
+// ----------------------------------------
+#ifdef MY_ASSERT_HAS_SIGSAFE_LINE
+namespace my_assert
+{
+namespace detail
+{
+// Record formatted on the stack and written with one write(2): usable in signal handlers.
+class sigsafe_line
+{
+public:
+    static constexpr std::size_t capacity = 512;
+
+    sigsafe_line()
+    {
+        reset();
+    }
+
+    // Empty record, with the timestamp prefix when timestamps are enabled.
+    void reset()
+    {
+        size_ = 0;
+        if (g_timestamps.load(std::memory_order_relaxed))
+        {
+            timespec now{};
+            ::clock_gettime(CLOCK_REALTIME, &now);
+            append("[");
+            append_unsigned(static_cast<unsigned long long>(now.tv_sec));
+            append(".");
+            auto usec = static_cast<unsigned long long>(now.tv_nsec / 1000);
+            for (auto digit = 100000ull; digit > 1 && usec < digit; digit /= 10)
+            {
+                append("0");
+            }
+            append_unsigned(usec);
+            append("] ");
+        }
+    }
+
+    void append(const char* text)
+    {
+        for (; *text && size_ < capacity - 1; ++text)
+        {
+            data_[size_++] = *text;
+        }
+    }
+
+    void append(std::string_view text)
+    {
+        for (auto c : text)
+        {
+            if (size_ >= capacity - 1)
+            {
+                break;
+            }
+            data_[size_++] = c;
+        }
+    }
+
+    template <typename T>
+    void append_value(T value)
+    {
+        static_assert(std::is_integral_v<T> || std::is_enum_v<T> || std::is_pointer_v<T> ||
+                          std::is_null_pointer_v<T>,
+                      "MYDEBUG_SIGSAFE supports integers, pointers and string literals");
+        if constexpr (std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>)
+        {
+            char text[2] = {static_cast<char>(value), 0};
+            append(text);
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            auto name = enum_name(value);
+            if (!name.empty())
+            {
+                append(name);
+            }
+            else
+            {
+                append_value(+static_cast<std::underlying_type_t<T>>(value));
+            }
+        }
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+        {
+            auto magnitude = static_cast<unsigned long long>(value);
+            if (value < 0)
+            {
+                append("-");
+                magnitude = 0 - magnitude;
+            }
+            append_unsigned(magnitude);
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            append_unsigned(static_cast<unsigned long long>(value));
+        }
+        else if constexpr (std::is_same_v<std::decay_t<std::remove_pointer_t<T>>, char>)
+        {
+            append(value ? value : "(null)");
+        }
+        else
+        {
+            append_pointer(reinterpret_cast<std::uintptr_t>(static_cast<const volatile void*>(value)));
+        }
+    }
+
+    const char* data() const
+    {
+        return data_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    // Keeps the line break of truncated records.
+    void finish()
+    {
+        if (size_ == capacity - 1)
+        {
+            data_[size_ - 1] = '\n';
+        }
+    }
+
+    // Uncompressed async output gets the line on its descriptor (unordered with buffered records), stderr otherwise.
+    void write()
+    {
+        finish();
+        write_all(g_raw_output_fd.load(std::memory_order_relaxed), data_, size_);
+    }
+
+private:
+    void append_unsigned(unsigned long long value)
+    {
+        char digits[24];
+        auto count = 0;
+        do
+        {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value);
+        while (count > 0 && size_ < capacity - 1)
+        {
+            data_[size_++] = digits[--count];
+        }
+    }
+
+    void append_pointer(std::uintptr_t value)
+    {
+        if (!value)
+        {
+            append("0"); // as std::ostream prints null pointers
+            return;
+        }
+        char digits[2 * sizeof(value) + 1];
+        auto count = 0;
+        for (; value; value >>= 4)
+        {
+            digits[count++] = "0123456789abcdef"[value & 15];
+        }
+        append("0x");
+        while (count > 0 && size_ < capacity - 1)
+        {
+            data_[size_++] = digits[--count];
+        }
+    }
+
+    char data_[capacity];
+    std::size_t size_ = 0;
+};
+} // namespace detail
+} // namespace my_assert
+#endif // MY_ASSERT_HAS_SIGSAFE_LINE
+
+// -----------------------
+// === Site statistics ===
+// -----------------------
+namespace my_assert
+{
+namespace detail
+{
+enum class site_kind
+{
+    lock,
+    debug,
+    warning,
+    assertion,
+    timer,
+};
+
+inline const char* site_kind_name(site_kind kind)
+{
+    switch (kind)
+    {
+    case site_kind::lock:
+        return "lock";
+    case site_kind::debug:
+        return "debug";
+    case site_kind::warning:
+        return "warning";
+    case site_kind::assertion:
+        return "assertion";
+    case site_kind::timer:
+        return "timer";
+    }
+    return "";
+}
+
+constexpr std::uint32_t site_flag_initialized = 1;
+constexpr std::uint32_t site_flag_enabled = 2;
+constexpr int histogram_buckets = 40; // bucket i counts values in [2^(i-1), 2^i) ns
+
+// Statistics of one code site. Sites are linked into a global list on first use and reported at exit.
+// hits: acquisitions for locks, printed records for debug and warnings, failures for assertions,
+// completed scopes for timers.
+struct site_stats
+{
+    const char* location;
+    site_kind kind;
+    const char* expr;
+    std::atomic<site_stats*> next{nullptr};
+    std::atomic<bool> registered{false};
+    std::atomic<std::uint32_t> flags{0};
+    std::atomic<std::uint32_t> counter_slot{0}; // index in per-thread evaluation counters, 0 is unassigned
+    std::atomic<std::uint32_t> rate_limit{0}; // records per second, 0 is unlimited
+    std::atomic<std::uint64_t> window_start{0};
+    std::atomic<std::uint32_t> window_count{0};
+    std::atomic<std::uint64_t> hits{0};
+    std::atomic<std::uint64_t> suppressed{0};
+    std::atomic<std::uint64_t> contended{0};
+    std::atomic<std::uint64_t> total_ns{0}; // lock wait or timed scope duration
+    std::atomic<std::uint64_t> max_ns{0};
+    std::atomic<std::uint64_t> histogram[histogram_buckets]{};
+    std::atomic<std::uint64_t> cost_cycles{0}; // estimated condition cost since cost_since (MY_ASSERT_ADAPTIVE)
+    std::atomic<std::uint64_t> cost_since{0};
+    std::atomic<std::uint32_t> skip_mask{0}; // evaluated once per skip_mask + 1 executions
+
+    constexpr site_stats(const char* location_, site_kind kind_, const char* expr_ = "")
+        : location(location_), kind(kind_), expr(expr_)
+    {
+    }
+};
+
+MY_ASSERT_CONSTINIT inline std::atomic<site_stats*> g_sites{nullptr};
+
+inline void record_histogram(site_stats& site, std::uint64_t ns)
+{
+    auto bucket = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+    site.histogram[std::min(bucket, histogram_buckets - 1)].fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void update_max(std::atomic<std::uint64_t>& max, std::uint64_t value)
+{
+    auto current = max.load(std::memory_order_relaxed);
+    while (current < value && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+inline void register_site(site_stats& site)
+{
+    if (site.registered.exchange(true, std::memory_order_acq_rel))
+    {
+        return;
+    }
+    auto* head = g_sites.load(std::memory_order_relaxed);
+    do
+    {
+        site.next.store(head, std::memory_order_relaxed);
+    } while (!g_sites.compare_exchange_weak(head, &site, std::memory_order_seq_cst, std::memory_order_relaxed));
+}
+
+// Applies the site rules to a new site; set by the first rule update (see "Site rules").
+MY_ASSERT_CONSTINIT inline std::atomic<std::uint32_t (*)(site_stats&)> g_apply_site_rules{nullptr};
+
+// Without rules a site is enabled and unlimited. A new site is registered before the hook is read, and the first
+// rule update sets the hook before it walks the sites, so one of them applies the rules to the site.
+[[gnu::noinline, gnu::cold]] inline std::uint32_t init_site(site_stats& site)
+{
+    register_site(site);
+    if (auto* apply_site_rules = g_apply_site_rules.load(std::memory_order_seq_cst))
+    {
+        return apply_site_rules(site);
+    }
+    std::uint32_t expected = 0;
+    site.flags.compare_exchange_strong(expected, site_flag_initialized | site_flag_enabled, std::memory_order_relaxed);
+    return site.flags.load(std::memory_order_relaxed);
+}
+
+// Hot path of MYDEBUG/MYWARNING: one relaxed load once the site is initialized.
+inline bool site_enabled(site_stats& site)
+{
+    auto flags = site.flags.load(std::memory_order_relaxed);
+    if (__builtin_expect(flags == 0, 0))
+    {
+        flags = init_site(site);
+    }
+    return flags & site_flag_enabled;
+}
+
+// Counts a record that is about to be printed, or drops it if the site exceeds its rate limit.
+inline bool site_admit(site_stats& site)
+{
+    if (auto limit = site.rate_limit.load(std::memory_order_relaxed))
+    {
+        auto second = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch())
+                .count());
+        auto window = site.window_start.load(std::memory_order_relaxed);
+        if (window != second && site.window_start.compare_exchange_strong(window, second, std::memory_order_relaxed))
+        {
+            site.window_count.store(0, std::memory_order_relaxed);
+        }
+        if (site.window_count.fetch_add(1, std::memory_order_relaxed) >= limit)
+        {
+            site.suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    site.hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+[[gnu::noinline, gnu::cold]] inline void site_failed(site_stats& site)
+{
+    register_site(site);
+    site.hits.fetch_add(1, std::memory_order_relaxed);
+}
+
+#ifdef MY_ASSERT_HAS_EVAL_COUNTERS
+// Evaluation counters live in per-thread blocks: the owner thread increments without a locked instruction,
+// collectors sum all blocks with relaxed loads. Blocks of exited threads are reused, so sums never go back.
+constexpr std::uint32_t max_counted_sites = 4096;
+constexpr std::uint32_t counter_slot_overflow = ~0u;
+
+struct thread_counters
+{
+    std::atomic<std::uint64_t> values[max_counted_sites];
+    std::atomic<bool> in_use;
+    thread_counters* next;
+};
+
+MY_ASSERT_CONSTINIT inline std::atomic<thread_counters*> g_thread_counters{nullptr};
+MY_ASSERT_CONSTINIT inline std::atomic<std::uint32_t> g_next_counter_slot{1};
+MY_ASSERT_CONSTINIT inline thread_local thread_counters* t_counters = nullptr;
+
+// Returns the block of an exited thread when its last owner goes away.
+struct thread_counters_owner
+{
+    ~thread_counters_owner()
+    {
+        if (t_counters)
+        {
+            t_counters->in_use.store(false, std::memory_order_release);
+            t_counters = nullptr;
+        }
+    }
+};
+
+#    ifdef MY_ASSERT_HAS_FORK_HANDLERS
+// Only the forking thread exists in a child: the blocks of the others are released for reuse.
+inline void release_counters_in_child()
+{
+    auto reset = g_reset_stats_on_fork.load(std::memory_order_relaxed);
+    for (auto* block = g_thread_counters.load(std::memory_order_acquire); block; block = block->next)
+    {
+        if (block != t_counters)
+        {
+            block->in_use.store(false, std::memory_order_relaxed);
+        }
+        if (reset)
+        {
+            for (auto& value : block->values)
+            {
+                value.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+#    endif
+
+[[gnu::noinline, gnu::cold]] inline void count_evaluation_slow(site_stats& site)
+{
+    if (site.counter_slot.load(std::memory_order_relaxed) == 0)
+    {
+        register_site(site);
+        auto slot = g_next_counter_slot.fetch_add(1, std::memory_order_relaxed);
+        std::uint32_t expected = 0;
+        site.counter_slot.compare_exchange_strong(expected, slot < max_counted_sites ? slot : counter_slot_overflow,
+                                                  std::memory_order_relaxed);
+    }
+    if (!t_counters)
+    {
+        static thread_local thread_counters_owner owner;
+        (void)owner;
+        for (auto* block = g_thread_counters.load(std::memory_order_acquire); block && !t_counters; block = block->next)
+        {
+            auto expected = false;
+            if (block->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            {
+                t_counters = block;
+            }
+        }
+        if (!t_counters)
+        {
+            auto* block = new thread_counters{};
+            block->in_use.store(true, std::memory_order_relaxed);
+            block->next = g_thread_counters.load(std::memory_order_relaxed);
+            while (!g_thread_counters.compare_exchange_weak(block->next, block, std::memory_order_release,
+                                                            std::memory_order_relaxed))
+            {
+            }
+            t_counters = block;
+#    ifdef MY_ASSERT_HAS_FORK_HANDLERS
+            set_fork_handlers(fork_slot_counters, nullptr, nullptr, release_counters_in_child);
+#    endif
+        }
+    }
+    auto slot = site.counter_slot.load(std::memory_order_relaxed);
+    if (slot != counter_slot_overflow)
+    {
+        t_counters->values[slot].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline void count_evaluation(site_stats& site)
+{
+    auto slot = site.counter_slot.load(std::memory_order_relaxed);
+    auto* counters = t_counters;
+    if (__builtin_expect(slot == 0 || slot == counter_slot_overflow || !counters, 0))
+    {
+        count_evaluation_slow(site);
+        return;
+    }
+    auto& value = counters->values[slot];
+    value.store(value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); // single writer
+}
+
+// Whether evaluations of the site are counted (its translation unit defines MY_ASSERT_EVAL_COUNTERS).
+inline bool counts_evaluations(const site_stats& site)
+{
+    auto slot = site.counter_slot.load(std::memory_order_relaxed);
+    return slot != 0 && slot != counter_slot_overflow;
+}
+
+// Sum over all threads; workers keep running while it is collected.
+inline std::uint64_t evaluations(const site_stats& site)
+{
+    auto slot = site.counter_slot.load(std::memory_order_relaxed);
+    if (slot == 0 || slot == counter_slot_overflow)
+    {
+        return 0;
+    }
+    std::uint64_t total = 0;
+    for (auto* block = g_thread_counters.load(std::memory_order_acquire); block; block = block->next)
+    {
+        total += block->values[slot].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+#endif // MY_ASSERT_HAS_EVAL_COUNTERS
+
+#ifdef MY_ASSERT_ADAPTIVE
+// Timestamp counter for cheap cost sampling (steady clock nanoseconds on other architectures).
+inline std::uint64_t cycles()
+{
+#    if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#    else
+    return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#    endif
+}
+
+constexpr std::uint32_t adaptive_sample_period = 64; // time one of 64 evaluations per thread, on average
+constexpr std::uint64_t adaptive_warmup_cycles = 1ull << 28; // no demotion during the first ~0.1 s
+constexpr std::uint32_t adaptive_max_skip_mask = 1023;
+
+MY_ASSERT_CONSTINIT inline std::atomic<double> g_assert_cost_budget{0.05};
+MY_ASSERT_CONSTINIT inline std::atomic<std::uint64_t> g_adaptive_start{0};
+MY_ASSERT_CONSTINIT inline thread_local std::uint32_t t_adaptive_sample = adaptive_sample_period;
+MY_ASSERT_CONSTINIT inline thread_local std::uint32_t t_adaptive_random = 0x9e3779b9u;
+
+// xorshift32 step of the per-thread generator.
+inline std::uint32_t adaptive_random()
+{
+    t_adaptive_random ^= t_adaptive_random << 13;
+    t_adaptive_random ^= t_adaptive_random >> 17;
+    t_adaptive_random ^= t_adaptive_random << 5;
+    return t_adaptive_random;
+}
+
+[[gnu::noinline, gnu::cold]] inline void demote_site(site_stats& site, std::uint64_t cost, std::uint64_t elapsed)
+{
+    auto mask = site.skip_mask.load(std::memory_order_relaxed);
+    if (mask >= adaptive_max_skip_mask)
+    {
+        return;
+    }
+    auto new_mask = mask ? mask * 2 + 1 : 15u;
+    if (!site.skip_mask.compare_exchange_strong(mask, new_mask, std::memory_order_relaxed))
+    {
+        return; // demoted by another thread
+    }
+    register_site(site);
+    site.cost_cycles.store(0, std::memory_order_relaxed);
+    site.cost_since.store(cycles(), std::memory_order_relaxed);
+    std::ostringstream oss;
+    oss << FORMAT_BEGIN(BOLD_CODE) << site.location << ": " FORMAT_END << MAGENTA_STR("assertion demoted: ")
+        << site.expr << " is now evaluated 1 of " << new_mask + 1 << " times, cost was "
+        << 100.0 * static_cast<double>(cost) / static_cast<double>(elapsed) << "% of runtime" << std::endl;
+    emit(oss.str());
+}
+
+inline void account_cost(site_stats& site, std::uint64_t cost)
+{
+    auto now = cycles();
+    auto start = g_adaptive_start.load(std::memory_order_relaxed);
+    if (start == 0)
+    {
+        g_adaptive_start.compare_exchange_strong(start, now, std::memory_order_relaxed);
+        return;
+    }
+    auto total = site.cost_cycles.fetch_add(cost, std::memory_order_relaxed) + cost;
+    auto since = std::max(start, site.cost_since.load(std::memory_order_relaxed));
+    auto elapsed = now - since;
+    auto budget = g_assert_cost_budget.load(std::memory_order_relaxed);
+    if (now - start > adaptive_warmup_cycles && elapsed > 0 &&
+        static_cast<double>(total) > budget * static_cast<double>(elapsed))
+    {
+        demote_site(site, total, elapsed);
+    }
+}
+
+// MYASSERT condition under MY_ASSERT_ADAPTIVE: skipped on demoted sites, timed on one of 64 evaluations.
+// Both decisions are random, so that sites executed in a fixed pattern are all sampled, and a demoted site is
+// evaluated 1 of skip_mask + 1 times whatever other demoted sites run between its executions.
+template <typename F>
+inline bool adaptive_check_failed(site_stats& site, F&& failed)
+{
+    auto mask = site.skip_mask.load(std::memory_order_relaxed);
+    if (mask && ((adaptive_random() >> 16) & mask))
+    {
+        return false;
+    }
+    if (__builtin_expect(--t_adaptive_sample != 0, 1))
+    {
+        return failed();
+    }
+    t_adaptive_sample = adaptive_sample_period / 2 + (adaptive_random() & (adaptive_sample_period - 1));
+    auto start = cycles();
+    auto result = failed();
+    account_cost(site, (cycles() - start) * adaptive_sample_period);
+    return result;
+}
+#endif // MY_ASSERT_ADAPTIVE
+} // namespace detail
+
+#ifdef MY_ASSERT_ADAPTIVE
+// Fraction of runtime that one MYASSERT condition may cost before it is demoted.
+inline void set_assert_cost_budget(double fraction)
+{
+    detail::g_assert_cost_budget.store(fraction, std::memory_order_relaxed);
+}
+#endif
+} // namespace my_assert
+
+// ------------------
+// === Site rules ===
+// ------------------
+// Enable, disable and rate rules for debug and warning sites, set by the control socket and the config file.
+#ifdef MY_ASSERT_HAS_SITE_RULES
+namespace my_assert
+{
+namespace detail
+{
+// Rules apply in order, a later matching rule overrides the settings it keeps.
+struct site_rule
+{
+    std::string pattern;
+    int enable; // 1 enable, 0 disable, -1 keep
+    std::int64_t rate_limit; // -1 keep
+};
+
+// "enable PATTERN", "disable PATTERN" or "rate PATTERN RECORDS_PER_SECOND" (0 is unlimited).
+inline bool parse_site_rule(const std::string& line, site_rule& rule)
+{
+    std::istringstream iss(line);
+    std::string command;
+    std::string pattern;
+    std::string extra;
+    iss >> command >> pattern;
+    if (pattern.empty())
+    {
+        return false;
+    }
+    if (command == "enable" || command == "disable")
+    {
+        rule = {pattern, command == "enable" ? 1 : 0, -1};
+        return !(iss >> extra);
+    }
+    std::int64_t rate = -1;
+    if (command == "rate" && (iss >> rate) && rate >= 0)
+    {
+        rule = {pattern, -1, rate};
+        return !(iss >> extra);
+    }
+    return false;
+}
+
+// Immutable set of rules, replaced as a whole through g_config (copy on write).
+// A replaced snapshot is freed after a grace period in which no reader holds it (RCU style).
+struct config_snapshot
+{
+    std::vector<site_rule> file_rules;    // from the watched config file
+    std::vector<site_rule> runtime_rules; // from the control socket
+};
+
+MY_ASSERT_CONSTINIT inline std::atomic<const config_snapshot*> g_config{nullptr};
+MY_ASSERT_CONSTINIT inline std::atomic<int> g_config_readers{0};
+MY_ASSERT_CONSTINIT inline std::mutex g_config_write_mutex;
+
+// Read-side critical section: the snapshot returned by get() stays alive until destruction.
+class config_reader
+{
+public:
+    config_reader()
+    {
+        g_config_readers.fetch_add(1, std::memory_order_seq_cst);
+    }
+
+    ~config_reader()
+    {
+        g_config_readers.fetch_sub(1, std::memory_order_release);
+    }
+
+    config_reader(const config_reader&) = delete;
+    config_reader& operator=(const config_reader&) = delete;
+
+    const config_snapshot* get() const
+    {
+        return g_config.load(std::memory_order_seq_cst);
+    }
+};
+
+// Shell-style glob: '*' matches any run of characters (including '/'), '?' one character, "[a-z]" and "[!0-9]" one
+// character of a set. Same rules as fnmatch(pattern, text, 0), without the POSIX dependency.
+inline bool glob_match(const char* pattern, const char* text)
+{
+    const char* star = nullptr; // pattern position after the last '*', retried with one more character eaten
+    const char* star_text = nullptr;
+    while (*text)
+    {
+        auto matched = false;
+        const auto* next = pattern + 1;
+        if (*pattern == '*')
+        {
+            star = ++pattern;
+            star_text = text;
+            continue;
+        }
+        if (*pattern == '?')
+        {
+            matched = true;
+        }
+        else if (*pattern == '[')
+        {
+            const auto* p = pattern + 1;
+            auto negate = *p == '!';
+            p += negate ? 1 : 0;
+            const auto* end = *p ? std::strchr(p + 1, ']') : nullptr; // a leading ']' belongs to the set
+            if (!end)
+            {
+                matched = *text == '['; // no set, a literal '['
+            }
+            else
+            {
+                auto in_set = false;
+                for (; p < end; ++p)
+                {
+                    if (p[1] == '-' && p + 2 < end)
+                    {
+                        in_set = in_set || (*text >= p[0] && *text <= p[2]);
+                        p += 2;
+                    }
+                    else
+                    {
+                        in_set = in_set || *text == *p;
+                    }
+                }
+                matched = in_set != negate;
+                next = end + 1;
+            }
+        }
+        else
+        {
+            matched = *pattern != '\0' && *pattern == *text;
+        }
+        if (matched)
+        {
+            pattern = next;
+            ++text;
+        }
+        else if (star)
+        {
+            pattern = star;
+            text = ++star_text;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (*pattern == '*')
+    {
+        ++pattern;
+    }
+    return *pattern == '\0';
+}
+
+// Glob match of pattern against location; patterns without '/' are matched against the file name only.
+inline bool site_matches(const site_stats& site, const std::string& pattern)
+{
+    const char* location = site.location;
+    if (pattern.find('/') == std::string::npos)
+    {
+        if (const auto* slash = std::strrchr(location, '/'))
+        {
+            location = slash + 1;
+        }
+    }
+    return glob_match(pattern.c_str(), location);
+}
+
+// Site state under a snapshot: enabled and unlimited by default, then file rules and runtime rules in order.
+inline void apply_config(site_stats& site, const config_snapshot* config)
+{
+    auto enabled = true;
+    std::uint32_t rate_limit = 0;
+    if (config && (site.kind == site_kind::debug || site.kind == site_kind::warning))
+    {
+        for (const auto* rules : {&config->file_rules, &config->runtime_rules})
+        {
+            for (const auto& rule : *rules)
+            {
+                if (!site_matches(site, rule.pattern))
+                {
+                    continue;
+                }
+                enabled = rule.enable >= 0 ? rule.enable == 1 : enabled;
+                rate_limit = rule.rate_limit >= 0 ? static_cast<std::uint32_t>(rule.rate_limit) : rate_limit;
+            }
+        }
+    }
+    site.rate_limit.store(rate_limit, std::memory_order_relaxed);
+    site.flags.store(site_flag_initialized | (enabled ? site_flag_enabled : 0), std::memory_order_relaxed);
+}
+
+// Hook of init_site: a concurrent update may apply its snapshot before ours, so retry until ours is the latest.
+inline std::uint32_t apply_site_rules(site_stats& site)
+{
+    config_reader reader;
+    for (const auto* config = reader.get();; )
+    {
+        apply_config(site, config);
+        const auto* latest = reader.get();
+        if (latest == config)
+        {
+            break;
+        }
+        config = latest;
+    }
+    return site.flags.load(std::memory_order_relaxed);
+}
+
+inline void lock_site_rules()
+{
+    g_config_write_mutex.lock();
+}
+
+inline void unlock_site_rules()
+{
+    g_config_write_mutex.unlock();
+}
+
+// Copy-on-write update: publishes the modified copy, applies it to all known sites
+// and frees the previous snapshot once no reader can hold it.
+template <typename F>
+inline void update_config(F&& update)
+{
+    set_fork_handlers(fork_slot_site_rules, lock_site_rules, unlock_site_rules, unlock_site_rules);
+    g_apply_site_rules.store(apply_site_rules, std::memory_order_seq_cst);
+    std::lock_guard<std::mutex> lock(g_config_write_mutex);
+    const auto* current = g_config.load(std::memory_order_relaxed);
+    auto* config = current ? new config_snapshot(*current) : new config_snapshot;
+    update(*config);
+    const auto* previous = g_config.exchange(config, std::memory_order_seq_cst);
+    for (auto* site = g_sites.load(std::memory_order_seq_cst); site; site = site->next.load(std::memory_order_relaxed))
+    {
+        apply_config(*site, config);
+    }
+    while (g_config_readers.load(std::memory_order_seq_cst) != 0)
+    {
+        std::this_thread::yield();
+    }
+    delete previous;
+}
+} // namespace detail
+} // namespace my_assert
+#endif // MY_ASSERT_HAS_SITE_RULES
+
+// ----------------------
+// === Real-time mode ===
+// ----------------------
+// With MY_ASSERT_REALTIME the macros never allocate, lock or block: records are formatted into a preallocated
+// per-thread ring (single producer, single consumer) and written by a drain thread; failures set an atomic flag.
+// The drain thread sleeps while the rings are empty; a producer only wakes it (FUTEX_WAKE, which never blocks),
+// and only when it is asleep.
+#ifdef MY_ASSERT_REALTIME
+namespace my_assert
+{
+namespace detail
+{
+struct realtime_slot
+{
+    site_stats* site;
+    bool failure;
+    sigsafe_line line;
+};
+
+struct realtime_ring
+{
+    static constexpr std::uint64_t capacity = 256;
+
+    alignas(64) std::atomic<std::uint64_t> head{0};
+    alignas(64) std::atomic<std::uint64_t> tail{0};
+    std::atomic<std::uint64_t> dropped{0};
+    std::uint64_t reported_dropped = 0; // drain thread only
+    std::atomic<bool> in_use{false};
+    realtime_ring* next = nullptr;
+    realtime_slot slots[capacity];
+};
+
+MY_ASSERT_CONSTINIT inline std::atomic<realtime_ring*> g_realtime_rings{nullptr};
+MY_ASSERT_CONSTINIT inline std::atomic<bool> g_realtime_failed{false};
+MY_ASSERT_CONSTINIT inline std::atomic<std::uint64_t> g_realtime_unattached{0}; // records of threads without a ring
+MY_ASSERT_CONSTINIT inline std::mutex g_realtime_drain_mutex; // between drain thread and exit, never producers
+MY_ASSERT_CONSTINIT inline thread_local realtime_ring* t_realtime_ring = nullptr;
+MY_ASSERT_CONSTINIT inline std::atomic<bool> g_realtime_drain_started{false};
+MY_ASSERT_CONSTINIT inline std::atomic<bool> g_realtime_drain_sleeping{false};
+MY_ASSERT_CONSTINIT inline std::atomic<std::uint32_t> g_realtime_drain_wakeups{0}; // futex word
+
+// Called by producers after publishing a record.
+inline void wake_realtime_drain()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in wait_realtime_records
+    if (__builtin_expect(g_realtime_drain_sleeping.load(std::memory_order_relaxed), 0))
+    {
+        g_realtime_drain_sleeping.store(false, std::memory_order_relaxed);
+        g_realtime_drain_wakeups.fetch_add(1, std::memory_order_release);
+#    if defined(__linux__)
+        ::syscall(SYS_futex, &g_realtime_drain_wakeups, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#    endif
+    }
+}
+
+inline bool realtime_records_pending()
+{
+    for (auto* ring = g_realtime_rings.load(std::memory_order_acquire); ring; ring = ring->next)
+    {
+        if (ring->head.load(std::memory_order_acquire) != ring->tail.load(std::memory_order_relaxed))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Drain thread: blocks until a producer publishes a record (polls every 100 ms without futexes).
+inline void wait_realtime_records()
+{
+    auto wakeups = g_realtime_drain_wakeups.load(std::memory_order_acquire);
+    g_realtime_drain_sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!realtime_records_pending())
+    {
+#    if defined(__linux__)
+        ::syscall(SYS_futex, &g_realtime_drain_wakeups, FUTEX_WAIT_PRIVATE, wakeups, nullptr, nullptr, 0);
+#    else
+        (void)wakeups;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+#    endif
+    }
+    g_realtime_drain_sleeping.store(false, std::memory_order_relaxed);
+}
+
+// Sites are initialized by the drain thread: until then they count as enabled.
+inline bool realtime_site_enabled(const site_stats& site)
+{
+    auto flags = site.flags.load(std::memory_order_relaxed);
+    return flags == 0 || (flags & site_flag_enabled);
+}
+
+template <typename F>
+inline void realtime_push(site_stats& site, bool failure, F&& format)
+{
+    auto* ring = t_realtime_ring;
+    if (__builtin_expect(!ring, 0))
+    {
+        g_realtime_unattached.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) == realtime_ring::capacity)
+    {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto& slot = ring->slots[head % realtime_ring::capacity];
+    slot.site = &site;
+    slot.failure = failure;
+    slot.line.reset();
+    format(slot.line);
+    slot.line.finish();
+    ring->head.store(head + 1, std::memory_order_release);
+    wake_realtime_drain();
+}
+
+[[gnu::noinline, gnu::cold]] inline void realtime_failure(site_stats& site, const char* prefix, const char* text)
+{
+    g_realtime_failed.store(true, std::memory_order_relaxed);
+    site.hits.fetch_add(1, std::memory_order_relaxed);
+    realtime_push(site, true, [&](sigsafe_line& line) {
+        line.append(prefix);
+        line.append(text);
+        line.append("\n");
+    });
+}
+
+[[gnu::noinline, gnu::cold]] inline void realtime_warning(site_stats& site, const char* prefix)
+{
+    realtime_push(site, false, [&](sigsafe_line& line) {
+        line.append(prefix);
+        line.append("\n");
+    });
+}
+
+template <typename T>
+inline void realtime_debug(site_stats& site, const char* prefix, T value)
+{
+    realtime_push(site, false, [&](sigsafe_line& line) {
+        line.append(prefix);
+        line.append_value(value);
+        line.append("\n");
+    });
+}
+
+// Unreachable code cannot continue: the record is written directly, then the macro throws or aborts.
+[[gnu::noinline, gnu::cold]] inline void realtime_unreachable(const char* prefix, const char* text)
+{
+    g_realtime_failed.store(true, std::memory_order_relaxed);
+    sigsafe_line line;
+    line.append(prefix);
+    line.append(text);
+    line.append("\n");
+    line.write();
+}
+
+// Returns whether any record was written.
+inline bool drain_realtime_rings()
+{
+    std::lock_guard<std::mutex> lock(g_realtime_drain_mutex);
+    auto drained = false;
+    for (auto* ring = g_realtime_rings.load(std::memory_order_acquire); ring; ring = ring->next)
+    {
+        auto tail = ring->tail.load(std::memory_order_relaxed);
+        auto head = ring->head.load(std::memory_order_acquire);
+        auto failure = false;
+        for (; tail != head; ++tail)
+        {
+            auto& slot = ring->slots[tail % realtime_ring::capacity];
+            if (slot.site->flags.load(std::memory_order_relaxed) == 0)
+            {
+                init_site(*slot.site);
+            }
+            register_site(*slot.site);
+            failure |= slot.failure;
+            write_record(std::string(slot.line.data(), slot.line.size()), false);
+            ring->tail.store(tail + 1, std::memory_order_release);
+            drained = true;
+        }
+        auto dropped = ring->dropped.load(std::memory_order_relaxed);
+        if (dropped != ring->reported_dropped)
+        {
+            std::ostringstream oss;
+            oss << MAGENTA_STR("real-time warning: ") << dropped - ring->reported_dropped
+                << " records dropped (ring full)" << std::endl;
+            write_record(oss.str(), false);
+            ring->reported_dropped = dropped;
+        }
+        if (failure)
+        {
+            write_record("", true);
+        }
+    }
+    return drained;
+}
+
+inline void drain_realtime_rings_at_exit()
+{
+    drain_realtime_rings();
+}
+
+// Returns the ring of an exited thread for reuse once it has been drained.
+struct realtime_ring_owner
+{
+    ~realtime_ring_owner()
+    {
+        if (t_realtime_ring)
+        {
+            t_realtime_ring->in_use.store(false, std::memory_order_release);
+            t_realtime_ring = nullptr;
+        }
+    }
+};
+
+// Also restarts the thread in a forked child.
+inline void start_realtime_drain()
+{
+    if (g_realtime_drain_started.exchange(true, std::memory_order_acq_rel))
+    {
+        return;
+    }
+    MY_ASSERT_CONSTINIT static std::atomic<bool> exit_registered{false};
+    if (!exit_registered.exchange(true, std::memory_order_acq_rel))
+    {
+        std::atexit(drain_realtime_rings_at_exit);
+    }
+    std::thread([] {
+        while (true)
+        {
+            if (drain_realtime_rings())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1)); // batch the records of busy producers
+            }
+            else
+            {
+                wait_realtime_records();
+            }
+        }
+    }).detach();
+}
+
+inline void lock_realtime_drain()
+{
+    g_realtime_drain_mutex.lock();
+}
+
+inline void unlock_realtime_drain()
+{
+    g_realtime_drain_mutex.unlock();
+}
+
+// Pending records are written by the parent; rings of threads that do not exist in the child are released, and the
+// drain thread is restarted at once, as producers never start it.
+inline void restart_realtime_drain_in_child()
+{
+    g_realtime_drain_mutex.unlock();
+    for (auto* ring = g_realtime_rings.load(std::memory_order_acquire); ring; ring = ring->next)
+    {
+        ring->tail.store(ring->head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        ring->reported_dropped = ring->dropped.load(std::memory_order_relaxed);
+        if (ring != t_realtime_ring)
+        {
+            ring->in_use.store(false, std::memory_order_relaxed);
+        }
+    }
+    if (g_realtime_drain_started.exchange(false, std::memory_order_relaxed))
+    {
+        start_realtime_drain();
+    }
+}
+} // namespace detail
+
+// Prepares the calling thread for MY_ASSERT_REALTIME macros (allocates its ring, starts the drain thread).
+// Call before entering the latency-critical loop; records of threads that did not call it are only counted.
+inline void realtime_thread_init()
+{
+    if (detail::t_realtime_ring)
+    {
+        return;
+    }
+    static thread_local detail::realtime_ring_owner owner;
+    (void)owner;
+    for (auto* ring = detail::g_realtime_rings.load(std::memory_order_acquire); ring; ring = ring->next)
+    {
+        auto expected = false;
+        if (ring->tail.load(std::memory_order_acquire) == ring->head.load(std::memory_order_relaxed) &&
+            ring->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+        {
+            detail::t_realtime_ring = ring;
+            detail::start_realtime_drain();
+            return;
+        }
+    }
+    auto* ring = new detail::realtime_ring;
+    ring->in_use.store(true, std::memory_order_relaxed);
+    ring->next = detail::g_realtime_rings.load(std::memory_order_relaxed);
+    while (!detail::g_realtime_rings.compare_exchange_weak(ring->next, ring, std::memory_order_release,
+                                                             std::memory_order_relaxed))
+    {
+    }
+    detail::t_realtime_ring = ring;
+    detail::start_realtime_drain();
+    detail::set_fork_handlers(detail::fork_slot_realtime, detail::lock_realtime_drain, detail::unlock_realtime_drain,
+                              detail::restart_realtime_drain_in_child);
+}
+
+// True once any MYASSERT/MYWARNING/MYUNREACHABLE failed in real-time mode (the macros do not throw by default).
+inline bool realtime_failed()
+{
+    return detail::g_realtime_failed.load(std::memory_order_relaxed);
+}
+} // namespace my_assert
+#endif // MY_ASSERT_REALTIME
+
+// ----------------------------------
+// === Floating-point span checks ===
+// ----------------------------------
+#ifdef MY_ASSERT_FP_CHECKS
+namespace my_assert
+{
+namespace detail
+{
+enum class fp_check
+{
+    finite,
+    nan,
+    denormal
+};
+
+template <typename T>
+struct fp_bits;
+
+template <>
+struct fp_bits<float>
+{
+    using type = std::int32_t; // values are compared with the sign bit cleared, so signed compares are exact
+    static constexpr type abs_mask = 0x7fffffff;
+    static constexpr type exp_mask = 0x7f800000;
+    static constexpr type min_normal = 0x00800000;
+};
+
+template <>
+struct fp_bits<double>
+{
+    using type = std::int64_t;
+    static constexpr type abs_mask = 0x7fffffffffffffff;
+    static constexpr type exp_mask = 0x7ff0000000000000;
+    static constexpr type min_normal = 0x0010000000000000;
+};
+
+// Bad values are exactly those with (bits & abs_mask) in [lo, hi].
+template <typename T>
+struct fp_range
+{
+    typename fp_bits<T>::type lo;
+    typename fp_bits<T>::type hi;
+};
+
+template <typename T>
+constexpr fp_range<T> fp_bad_range(fp_check check)
+{
+    using bits = fp_bits<T>;
+    switch (check)
+    {
+    case fp_check::finite:
+        return {bits::exp_mask, bits::abs_mask}; // infinities and NaNs
+    case fp_check::nan:
+        return {bits::exp_mask + 1, bits::abs_mask};
+    default:
+        return {1, bits::min_normal - 1}; // subnormals, zeros are fine
+    }
+}
+
+template <typename T>
+inline std::size_t fp_find_bad(const T* data, std::size_t size, fp_range<T> range)
+{
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        typename fp_bits<T>::type value;
+        std::memcpy(&value, data + i, sizeof(value));
+        value &= fp_bits<T>::abs_mask;
+        if (value >= range.lo && value <= range.hi)
+        {
+            return i;
+        }
+    }
+    return size;
+}
+
+#    if defined(__x86_64__) || defined(__i386__)
+constexpr std::size_t fp_block = 1024; // elements scanned between early-exit tests
+
+template <typename T>
+[[gnu::target("avx2")]] inline bool fp_any_bad_avx2(const T* data, std::size_t size, fp_range<T> range)
+{
+    constexpr auto lanes = 32 / sizeof(T);
+    std::size_t i = 0;
+    while (i + lanes <= size)
+    {
+        auto bad = _mm256_setzero_si256();
+        auto block_end = std::min(size - size % lanes, i + fp_block);
+        for (; i < block_end; i += lanes)
+        {
+            auto value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            if constexpr (sizeof(T) == 4)
+            {
+                value = _mm256_and_si256(value, _mm256_set1_epi32(fp_bits<T>::abs_mask));
+                auto above_hi = _mm256_cmpgt_epi32(value, _mm256_set1_epi32(range.hi));
+                auto above_lo = _mm256_cmpgt_epi32(value, _mm256_set1_epi32(range.lo - 1));
+                bad = _mm256_or_si256(bad, _mm256_andnot_si256(above_hi, above_lo));
+            }
+            else
+            {
+                value = _mm256_and_si256(value, _mm256_set1_epi64x(fp_bits<T>::abs_mask));
+                auto above_hi = _mm256_cmpgt_epi64(value, _mm256_set1_epi64x(range.hi));
+                auto above_lo = _mm256_cmpgt_epi64(value, _mm256_set1_epi64x(range.lo - 1));
+                bad = _mm256_or_si256(bad, _mm256_andnot_si256(above_hi, above_lo));
+            }
+        }
+        if (!_mm256_testz_si256(bad, bad))
+        {
+            return true;
+        }
+    }
+    return fp_find_bad(data + i, size - i, range) != size - i;
+}
+
+template <typename T>
+[[gnu::target("avx512f")]] inline bool fp_any_bad_avx512(const T* data, std::size_t size, fp_range<T> range)
+{
+    constexpr auto lanes = 64 / sizeof(T);
+    std::size_t i = 0;
+    while (i + lanes <= size)
+    {
+        unsigned bad = 0;
+        auto block_end = std::min(size - size % lanes, i + fp_block);
+        for (; i < block_end; i += lanes)
+        {
+            if constexpr (sizeof(T) == 4)
+            {
+                auto value = _mm512_and_si512(_mm512_loadu_si512(data + i), _mm512_set1_epi32(fp_bits<T>::abs_mask));
+                bad |= _mm512_cmpgt_epi32_mask(value, _mm512_set1_epi32(range.lo - 1)) &
+                       ~_mm512_cmpgt_epi32_mask(value, _mm512_set1_epi32(range.hi));
+            }
+            else
+            {
+                auto value = _mm512_and_si512(_mm512_loadu_si512(data + i), _mm512_set1_epi64(fp_bits<T>::abs_mask));
+                bad |= _mm512_cmpgt_epi64_mask(value, _mm512_set1_epi64(range.lo - 1)) &
+                       ~_mm512_cmpgt_epi64_mask(value, _mm512_set1_epi64(range.hi));
+            }
+        }
+        if (bad)
+        {
+            return true;
+        }
+    }
+    return fp_find_bad(data + i, size - i, range) != size - i;
+}
+
+// 0: scalar, 1: AVX2, 2: AVX-512 (detected on first use).
+inline int fp_isa()
+{
+    MY_ASSERT_CONSTINIT static std::atomic<int> isa{-1};
+    auto value = isa.load(std::memory_order_relaxed);
+    if (__builtin_expect(value < 0, 0))
+    {
+        __builtin_cpu_init();
+        value = __builtin_cpu_supports("avx512f") ? 2 : __builtin_cpu_supports("avx2") ? 1 : 0;
+        isa.store(value, std::memory_order_relaxed);
+    }
+    return value;
+}
+#    endif
+
+template <typename T>
+inline bool fp_any_bad(const T* data, std::size_t size, fp_check check)
+{
+    static_assert(std::is_same_v<T, float> || std::is_same_v<T, double>, "float or double spans are supported");
+    auto range = fp_bad_range<T>(check);
+#    if defined(__x86_64__) || defined(__i386__)
+    switch (fp_isa())
+    {
+    case 2:
+        return fp_any_bad_avx512(data, size, range);
+    case 1:
+        return fp_any_bad_avx2(data, size, range);
+    default:
+        break;
+    }
+#    endif
+    return fp_find_bad(data, size, range) != size;
+}
+
+inline const char* fp_check_text(fp_check check)
+{
+    return check == fp_check::finite ? " is not finite" : check == fp_check::nan ? " is NaN" : " is denormal";
+}
+
+// Cold path: locates the first bad element and reports it.
+template <typename T>
+[[gnu::noinline, gnu::cold]] void fp_check_failed(site_stats& site, const char* location, const char* name,
+                                                  const T* data, std::size_t size, fp_check check)
+{
+    auto index = fp_find_bad(data, size, fp_bad_range<T>(check));
+    site_failed(site);
+    auto message = std::string(name) + "[" + std::to_string(index) + "]" + fp_check_text(check);
+    std::ostringstream oss;
+    oss << FORMAT_BEGIN(BOLD_CODE) << location << ": " FORMAT_END << RED_STR("assertion check failed: ") << message
+        << " (" << data[index] << ")" << std::endl;
+    emit_failure(oss.str());
+    throw MyAssertException{message, location};
+}
+
+#    ifdef MY_ASSERT_REALTIME
+template <typename T>
+[[gnu::noinline, gnu::cold]] void realtime_fp_check_failed(site_stats& site, const char* location, const char* name,
+                                                           const T* data, std::size_t size, fp_check check)
+{
+    auto index = fp_find_bad(data, size, fp_bad_range<T>(check));
+    (void)location;
+    g_realtime_failed.store(true, std::memory_order_relaxed);
+    site.hits.fetch_add(1, std::memory_order_relaxed);
+    realtime_push(site, true, [&](sigsafe_line& line) {
+        line.append(FORMAT_BEGIN(BOLD_CODE));
+        line.append(site.location);
+        line.append(": " FORMAT_END RED_STR("assertion check failed: "));
+        line.append(name);
+        line.append("[");
+        line.append_value(index);
+        line.append("]");
+        line.append(fp_check_text(check));
+        line.append("\n");
+    });
+#        ifdef MY_ASSERT_REALTIME_EXCEPTIONS
+    throw MyAssertException{std::string(name) + "[" + std::to_string(index) + "]" + fp_check_text(check), location};
+#        endif
+}
+#    endif
+} // namespace detail
+} // namespace my_assert
+#endif // MY_ASSERT_FP_CHECKS
+
+// -------------------------------
+// === Accumulated loop checks ===
+// -------------------------------
+namespace my_assert
+{
+namespace detail
+{
+// Reports a failed MYASSERT_ACCUM_CHECK. count == 0: no rescan; first == count: the rescan found no failure.
+[[gnu::noinline, gnu::cold]] inline void accum_check_failed(site_stats& site, const char* location, const char* text,
+                                                            std::size_t first, std::size_t failing, std::size_t count)
+{
+    site_failed(site);
+    std::ostringstream message;
+    message << text;
+    if (count > 0 && first < count)
+    {
+        message << " at iteration " << first << " (" << failing << " of " << count << " iterations)";
+    }
+    else if (count > 0)
+    {
+        message << " in the loop, but not on rescan (condition depends on state changed since)";
+    }
+    std::ostringstream oss;
+    oss << FORMAT_BEGIN(BOLD_CODE) << location << ": " FORMAT_END << RED_STR("assertion check failed: ")
+        << message.str() << std::endl;
+    emit_failure(oss.str());
+    throw MyAssertException{message.str(), location};
+}
+
+// Reevaluates condition(i) for every iteration: first failing iteration (count if none) and number of failures.
+template <typename Condition>
+inline std::pair<std::size_t, std::size_t> accum_rescan(Condition&& condition, std::size_t count)
+{
+    auto first = count;
+    std::size_t failing = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (!condition(i))
+        {
+            first = std::min(first, i);
+            ++failing;
+        }
+    }
+    return {first, failing};
+}
+
+// Cold path of MYASSERT_ACCUM_CHECK(flag, condition, count).
+template <typename Condition>
+[[gnu::noinline, gnu::cold]] void accum_rescan_failed(site_stats& site, const char* location, const char* text,
+                                                      Condition&& condition, std::size_t count)
+{
+    auto [first, failing] = accum_rescan(condition, count);
+    accum_check_failed(site, location, text, first, failing, count);
+}
+
+#ifdef MY_ASSERT_REALTIME
+[[gnu::noinline, gnu::cold]] inline void realtime_accum_check_failed(site_stats& site, const char* location,
+                                                                     const char* text, std::size_t first,
+                                                                     std::size_t failing, std::size_t count)
+{
+    g_realtime_failed.store(true, std::memory_order_relaxed);
+    site.hits.fetch_add(1, std::memory_order_relaxed);
+    realtime_push(site, true, [&](sigsafe_line& line) {
+        line.append(FORMAT_BEGIN(BOLD_CODE));
+        line.append(site.location);
+        line.append(": " FORMAT_END RED_STR("assertion check failed: "));
+        line.append(text);
+        if (count > 0 && first < count)
+        {
+            line.append(" at iteration ");
+            line.append_value(first);
+            line.append(" (");
+            line.append_value(failing);
+            line.append(" of ");
+            line.append_value(count);
+            line.append(" iterations)");
+        }
+        line.append("\n");
+    });
+#    ifdef MY_ASSERT_REALTIME_EXCEPTIONS
+    throw MyAssertException{text, location};
+#    else
+    (void)location;
+#    endif
+}
+
+template <typename Condition>
+[[gnu::noinline, gnu::cold]] void realtime_accum_rescan_failed(site_stats& site, const char* location,
+                                                               const char* text, Condition&& condition,
+                                                               std::size_t count)
+{
+    auto [first, failing] = accum_rescan(condition, count);
+    realtime_accum_check_failed(site, location, text, first, failing, count);
+}
+#endif
+} // namespace detail
+} // namespace my_assert
+
+// --------------------------------------
+// === Floating-point exception traps ===
+// --------------------------------------
+#ifdef MY_ASSERT_FP_TRAPS
+namespace my_assert
+{
+namespace detail
+{
+struct fp_trap_state
+{
+    site_stats* site;
+    std::atomic<bool> trapped{false};
+};
+
+MY_ASSERT_CONSTINIT inline thread_local fp_trap_state* t_fp_trap_state = nullptr;
+
+#    ifdef MY_ASSERT_HAS_FP_TRAPS
+MY_ASSERT_CONSTINIT inline struct sigaction g_previous_sigfpe_action{};
+
+inline const char* fp_trap_name(int code)
+{
+    switch (code)
+    {
+    case FPE_FLTINV:
+        return "invalid operation (NaN produced)";
+    case FPE_FLTDIV:
+        return "division by zero";
+    case FPE_FLTOVF:
+        return "overflow";
+    case FPE_FLTUND:
+        return "underflow";
+    default:
+        return "inexact result";
+    }
+}
+
+// SIGFPE handler: reports the trapping instruction in the library format, then masks floating-point traps in
+// the interrupted context (x86-64) so the instruction completes with the IEEE result; aborts elsewhere.
+inline void fp_trap_handler(int signal, siginfo_t* info, void* context)
+{
+    auto* state = t_fp_trap_state;
+    auto floating = info->si_code == FPE_FLTINV || info->si_code == FPE_FLTDIV || info->si_code == FPE_FLTOVF ||
+                    info->si_code == FPE_FLTUND || info->si_code == FPE_FLTRES;
+    if (!floating)
+    {
+        auto& previous = g_previous_sigfpe_action;
+        if (previous.sa_flags & SA_SIGINFO)
+        {
+            previous.sa_sigaction(signal, info, context);
+        }
+        else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN)
+        {
+            previous.sa_handler(signal);
+        }
+        else
+        {
+            ::sigaction(SIGFPE, &previous, nullptr); // the instruction faults again with the default action
+        }
+        return;
+    }
+    sigsafe_line line;
+    if (state)
+    {
+        state->site->hits.fetch_add(1, std::memory_order_relaxed);
+        state->trapped.store(true, std::memory_order_relaxed);
+        line.append(FORMAT_BEGIN(BOLD_CODE));
+        line.append(state->site->location);
+        line.append(": " FORMAT_END);
+    }
+    line.append(RED_STR("floating-point trap: "));
+    line.append(fp_trap_name(info->si_code));
+    line.append(" at ");
+    line.append_value(info->si_addr);
+    line.append("\n");
+    line.write();
+#        if defined(__x86_64__) && defined(__linux__)
+    if (auto* fpu = static_cast<ucontext_t*>(context)->uc_mcontext.fpregs)
+    {
+        fpu->mxcsr |= 0x1f80; // SSE exception masks
+        fpu->cwd |= 0x3f;     // x87 exception masks
+        return;
+    }
+#        endif
+    std::abort();
+}
+
+inline void install_fp_trap_handler()
+{
+    MY_ASSERT_CONSTINIT static std::atomic<bool> installed{false};
+    if (installed.exchange(true, std::memory_order_acq_rel))
+    {
+        return;
+    }
+    struct sigaction action{};
+    action.sa_sigaction = fp_trap_handler;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    ::sigaction(SIGFPE, &action, &g_previous_sigfpe_action);
+}
+#    else
+// Without traps, the exception flags raised in the scope are reported when it ends.
+inline void report_fp_flags(fp_trap_state& state, int raised)
+{
+    if (!raised)
+    {
+        return;
+    }
+    state.site->hits.fetch_add(1, std::memory_order_relaxed);
+    state.trapped.store(true, std::memory_order_relaxed);
+    std::ostringstream oss;
+    oss << FORMAT_BEGIN(BOLD_CODE) << state.site->location << ": " FORMAT_END << RED_STR("floating-point exception: ");
+    auto first = true;
+    for (auto [flag, name] : {std::pair<int, const char*>{FE_INVALID, "invalid operation (NaN produced)"},
+                              {FE_DIVBYZERO, "division by zero"},
+                              {FE_OVERFLOW, "overflow"},
+                              {FE_UNDERFLOW, "underflow"},
+                              {FE_INEXACT, "inexact result"}})
+    {
+        if (raised & flag)
+        {
+            oss << (first ? "" : ", ") << name;
+            first = false;
+        }
+    }
+    oss << " in scope" << std::endl;
+    emit(oss.str());
+}
+#    endif
+} // namespace detail
+
+// Traps floating-point exceptions (feenableexcept) raised by this thread while the scope is alive; declared with
+// MYFP_TRAP. A trap is reported with the scope location and the address of the offending instruction; on x86-64
+// execution continues with traps masked until the end of the scope, so only the first trapping operation is
+// reported. The sticky exception flags are restored at the end of the scope.
+// Threads started inside the scope inherit the trap mask: their traps are reported without a location.
+// feenableexcept is a glibc extension: elsewhere nothing traps, and the exception flags raised in the scope are
+// reported (without an address) when it ends.
+class fp_trap_scope
+{
+public:
+    explicit fp_trap_scope(detail::site_stats& site, int excepts = FE_INVALID | FE_DIVBYZERO | FE_OVERFLOW)
+        : previous_state_(detail::t_fp_trap_state), excepts_(excepts)
+    {
+        if (__builtin_expect(!site.registered.load(std::memory_order_relaxed), 0))
+        {
+            detail::register_site(site);
+#    ifdef MY_ASSERT_HAS_FP_TRAPS
+            detail::install_fp_trap_handler();
+#    endif
+        }
+        state_.site = &site;
+        std::fegetexceptflag(&previous_flags_, FE_ALL_EXCEPT);
+        std::feclearexcept(excepts); // a flag already raised would trap at the next operation (x87)
+#    ifdef MY_ASSERT_HAS_FP_TRAPS
+        previous_excepts_ = ::fegetexcept();
+        ::feenableexcept(excepts);
+#    endif
+        detail::t_fp_trap_state = &state_;
+    }
+
+    ~fp_trap_scope()
+    {
+#    ifdef MY_ASSERT_HAS_FP_TRAPS
+        ::fedisableexcept(FE_ALL_EXCEPT);
+#    else
+        detail::report_fp_flags(state_, std::fetestexcept(excepts_));
+#    endif
+        std::fesetexceptflag(&previous_flags_, FE_ALL_EXCEPT);
+#    ifdef MY_ASSERT_HAS_FP_TRAPS
+        ::feenableexcept(previous_excepts_);
+#    endif
+        detail::t_fp_trap_state = previous_state_;
+    }
+
+    fp_trap_scope(const fp_trap_scope&) = delete;
+    fp_trap_scope& operator=(const fp_trap_scope&) = delete;
+
+    bool trapped() const
+    {
+#    ifdef MY_ASSERT_HAS_FP_TRAPS
+        return state_.trapped.load(std::memory_order_relaxed);
+#    else
+        return std::fetestexcept(excepts_) != 0;
+#    endif
+    }
+
+private:
+    detail::fp_trap_state state_;
+    detail::fp_trap_state* previous_state_;
+    int excepts_;
+    int previous_excepts_ = 0;
+    std::fexcept_t previous_flags_;
+};
+} // namespace my_assert
+
+// MYFP_TRAP(name) or MYFP_TRAP(name, excepts) declares fp_trap_scope name for the rest of the block.
+#    define MYFP_TRAP(...) MYFP_TRAP_(__VA_ARGS__, FE_INVALID | FE_DIVBYZERO | FE_OVERFLOW, )
+#    define MYFP_TRAP_(name, excepts, ...)                                                                             \
+    static my_assert::detail::site_stats CONCAT(my_assert_fp_trap_site_, __LINE__)(                                    \
+        LOCATION, my_assert::detail::site_kind::assertion);                                                            \
+    my_assert::fp_trap_scope name(CONCAT(my_assert_fp_trap_site_, __LINE__), excepts)
+#endif // MY_ASSERT_FP_TRAPS
+
+// ---------------------------------
+// === Lock-order checking mutex ===
+// ---------------------------------
+#ifdef MY_ASSERT_CHECKED_MUTEX
+namespace my_assert
+{
+class checked_mutex;
+
+namespace detail
+{
+// Global lock-order graph: edge a -> b means that b was acquired while holding a.
+struct lock_graph
+{
+    std::mutex mutex;
+    std::unordered_map<std::uint64_t, std::vector<std::uint64_t>> edges;
+    std::unordered_map<std::uint64_t, const char*> locations;
+    std::uint64_t next_id = 1;
+};
+
+inline lock_graph& get_lock_graph()
+{
+    static auto* graph = new lock_graph;
+    return *graph;
+}
+
+inline bool lock_graph_reaches(lock_graph& graph, std::uint64_t from, std::uint64_t to)
+{
+    std::vector<std::uint64_t> stack{from};
+    std::vector<std::uint64_t> visited;
+    while (!stack.empty())
+    {
+        auto id = stack.back();
+        stack.pop_back();
+        if (id == to)
+        {
+            return true;
+        }
+        if (std::find(visited.begin(), visited.end(), id) != visited.end())
+        {
+            continue;
+        }
+        visited.push_back(id);
+        auto it = graph.edges.find(id);
+        if (it != graph.edges.end())
+        {
+            stack.insert(stack.end(), it->second.begin(), it->second.end());
+        }
+    }
+    return false;
+}
+
+constexpr int max_held_locks = 32;
+constexpr int lock_edge_cache_size = 64;
+
+// Locks held by the current thread, in acquisition order.
+struct held_locks
+{
+    const checked_mutex* locks[max_held_locks];
+    int count;
+};
+
+// Edges already validated by the current thread. Lock ids are never reused, so entries never go stale.
+struct lock_edge_cache
+{
+    std::uint64_t from[lock_edge_cache_size];
+    std::uint64_t to[lock_edge_cache_size];
+};
+
+MY_ASSERT_CONSTINIT inline thread_local held_locks t_held_locks{};
+MY_ASSERT_CONSTINIT inline thread_local lock_edge_cache t_lock_edge_cache{};
+
+[[noreturn]] inline void lock_order_failure(const char* location, const std::string& message)
+{
+    std::ostringstream oss;
+    oss << FORMAT_BEGIN(BOLD_CODE) << location << ": " FORMAT_END << RED_STR("lock order check failed: ") << message
+        << std::endl;
+    emit_failure(oss.str());
+    throw MyAssertException{message, location};
+}
+
+// At exit: contention statistics of the locks.
+inline void report_sites()
+{
+    std::ostringstream oss;
+    for (auto* site = g_sites.load(std::memory_order_acquire); site; site = site->next.load(std::memory_order_relaxed))
+    {
+        switch (site->kind)
+        {
+        case site_kind::lock:
+        {
+            auto contended = site->contended.load(std::memory_order_relaxed);
+            if (contended == 0)
+            {
+                break;
+            }
+            oss << FORMAT_BEGIN(BOLD_CODE) << site->location << ": " FORMAT_END << CYAN_STR("lock stats: ")
+                << "acquisitions = " << site->hits.load(std::memory_order_relaxed) << ", contended = " << contended
+                << ", wait = " << site->total_ns.load(std::memory_order_relaxed) / 1000 << " us"
+                << ", max wait = " << site->max_ns.load(std::memory_order_relaxed) / 1000 << " us" << std::endl;
+            break;
+        }
+        case site_kind::debug:
+        case site_kind::warning:
+        case site_kind::assertion:
+        case site_kind::timer:
+            break;
+        }
+    }
+    if (!oss.str().empty())
+    {
+        emit(oss.str());
+    }
+}
+
+MY_ASSERT_CONSTINIT inline std::mutex g_intern_mutex;
+
+// Fork handlers: no interning and no graph update is in progress in the child.
+inline void lock_site_graph()
+{
+    g_intern_mutex.lock();
+    get_lock_graph().mutex.lock();
+}
+
+inline void unlock_site_graph()
+{
+    get_lock_graph().mutex.unlock();
+    g_intern_mutex.unlock();
+}
+
+// Site with runtime location (e.g. declaration point of an object). Interned and never freed.
+inline site_stats* intern_site(const char* file, int line, site_kind kind)
+{
+    MY_ASSERT_CONSTINIT static std::atomic<bool> registered{false};
+    if (!registered.exchange(true, std::memory_order_acq_rel))
+    {
+        std::atexit(report_sites);
+#    ifdef MY_ASSERT_HAS_FORK_HANDLERS
+        set_fork_handlers(fork_slot_lock_graph, lock_site_graph, unlock_site_graph, unlock_site_graph);
+#    endif
+    }
+    static auto* sites = new std::unordered_map<std::string, site_stats*>;
+    auto location = std::string(file) + ":" + std::to_string(line);
+    std::lock_guard<std::mutex> lock(g_intern_mutex);
+    auto it = sites->find(location);
+    if (it == sites->end())
+    {
+        it = sites->emplace(location, nullptr).first;
+        it->second = new site_stats{it->first.c_str(), kind};
+        register_site(*it->second);
+    }
+    return it->second;
+}
+} // namespace detail
+
+// Drop-in replacement for std::mutex.
+// Reports potential deadlocks (inverted acquisition order) by throwing MyAssertException before blocking,
+// and collects contention statistics per declaration site.
+class checked_mutex
+{
+public:
+    explicit checked_mutex(const char* file = __builtin_FILE(), int line = __builtin_LINE())
+        : site_(detail::intern_site(file, line, detail::site_kind::lock))
+    {
+        auto& graph = detail::get_lock_graph();
+        std::lock_guard<std::mutex> lock(graph.mutex);
+        id_ = graph.next_id++;
+        graph.locations[id_] = site_->location;
+    }
+
+    ~checked_mutex()
+    {
+        auto& graph = detail::get_lock_graph();
+        std::lock_guard<std::mutex> lock(graph.mutex);
+        graph.edges.erase(id_);
+        graph.locations.erase(id_);
+        for (auto& [from, to] : graph.edges)
+        {
+            to.erase(std::remove(to.begin(), to.end(), id_), to.end());
+        }
+    }
+
+    checked_mutex(const checked_mutex&) = delete;
+    checked_mutex& operator=(const checked_mutex&) = delete;
+
+    void lock()
+    {
+        check_order();
+        if (!mutex_.try_lock())
+        {
+            auto start = std::chrono::steady_clock::now();
+            mutex_.lock();
+            auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            site_->contended.fetch_add(1, std::memory_order_relaxed);
+            site_->total_ns.fetch_add(wait.count(), std::memory_order_relaxed);
+            detail::update_max(site_->max_ns, wait.count());
+            detail::record_histogram(*site_, wait.count());
+        }
+        push_held();
+    }
+
+    bool try_lock()
+    {
+        if (!mutex_.try_lock())
+        {
+            return false;
+        }
+        push_held();
+        return true;
+    }
+
+    void unlock()
+    {
+        auto& held = detail::t_held_locks;
+        for (int i = held.count - 1; i >= 0; --i)
+        {
+            if (held.locks[i] == this)
+            {
+                std::copy(held.locks + i + 1, held.locks + held.count, held.locks + i);
+                --held.count;
+                break;
+            }
+        }
+        mutex_.unlock();
+    }
+
+private:
+    void push_held()
+    {
+        auto& held = detail::t_held_locks;
+        if (held.count == detail::max_held_locks)
+        {
+            mutex_.unlock();
+            detail::lock_order_failure(site_->location, "too many nested locks");
+        }
+        held.locks[held.count++] = this;
+        site_->hits.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void check_order()
+    {
+        auto& held = detail::t_held_locks;
+        auto& cache = detail::t_lock_edge_cache;
+        for (int i = 0; i < held.count; ++i)
+        {
+            auto from = held.locks[i]->id_;
+            if (from == id_)
+            {
+                detail::lock_order_failure(site_->location, "recursive locking of non-recursive mutex");
+            }
+            auto slot = (from * 31 + id_) % detail::lock_edge_cache_size;
+            if (cache.from[slot] == from && cache.to[slot] == id_)
+            {
+                continue;
+            }
+            check_edge(*held.locks[i]);
+            cache.from[slot] = from;
+            cache.to[slot] = id_;
+        }
+    }
+
+    void check_edge(const checked_mutex& held)
+    {
+        auto& graph = detail::get_lock_graph();
+        std::unique_lock<std::mutex> lock(graph.mutex);
+        auto& edges = graph.edges[held.id_];
+        if (std::find(edges.begin(), edges.end(), id_) != edges.end())
+        {
+            return;
+        }
+        if (detail::lock_graph_reaches(graph, id_, held.id_))
+        {
+            lock.unlock();
+            detail::lock_order_failure(site_->location, std::string("potential deadlock: acquiring while holding ") +
+                                                            held.site_->location +
+                                                            ", but the opposite order was observed before");
+        }
+        edges.push_back(id_);
+    }
+
+    std::mutex mutex_;
+    std::uint64_t id_ = 0;
+    detail::site_stats* site_;
+};
+} // namespace my_assert
+#endif // MY_ASSERT_CHECKED_MUTEX
+
+// ----------------------
+// === Control socket ===
+// ----------------------
+#ifdef MY_ASSERT_CONTROL_SOCKET
+namespace my_assert
+{
+namespace detail
+{
+inline std::string list_sites()
+{
+    std::ostringstream oss;
+    for (auto* site = g_sites.load(std::memory_order_acquire); site; site = site->next.load(std::memory_order_relaxed))
+    {
+        auto enabled = site->kind == site_kind::lock || site->kind == site_kind::assertion ||
+                       (site->flags.load(std::memory_order_relaxed) & site_flag_enabled);
+        oss << site->location << " " << site_kind_name(site->kind) << " " << (enabled ? "enabled" : "disabled")
+            << " rate=" << site->rate_limit.load(std::memory_order_relaxed) << " expr=" << site->expr << "\n";
+    }
+    return oss.str();
+}
+
+// Plain-text dump of all sites (counters and histograms), used by the control socket.
+inline std::string dump_sites()
+{
+    std::ostringstream oss;
+    for (auto* site = g_sites.load(std::memory_order_acquire); site; site = site->next.load(std::memory_order_relaxed))
+    {
+        oss << site->location << " " << site_kind_name(site->kind) << " evaluations=" << evaluations(*site)
+            << " hits=" << site->hits.load(std::memory_order_relaxed)
+            << " suppressed=" << site->suppressed.load(std::memory_order_relaxed);
+        if (site->kind == site_kind::lock)
+        {
+            oss << " contended=" << site->contended.load(std::memory_order_relaxed)
+                << " wait_ns=" << site->total_ns.load(std::memory_order_relaxed)
+                << " max_wait_ns=" << site->max_ns.load(std::memory_order_relaxed);
+        }
+        if (site->kind == site_kind::timer)
+        {
+            oss << " total_ns=" << site->total_ns.load(std::memory_order_relaxed)
+                << " max_ns=" << site->max_ns.load(std::memory_order_relaxed);
+        }
+        auto first = true;
+        for (int i = 0; i < histogram_buckets; ++i)
+        {
+            if (auto count = site->histogram[i].load(std::memory_order_relaxed))
+            {
+                oss << (first ? " histogram_ns={" : ", ") << "<2^" << i << ":" << count;
+                first = false;
+            }
+        }
+        oss << (first ? "" : "}");
+        if (auto mask = site->skip_mask.load(std::memory_order_relaxed))
+        {
+            oss << " sampled=1/" << mask + 1;
+        }
+        oss << " expr=" << site->expr << "\n";
+    }
+    return oss.str();
+}
+
+// Commands (one per connection, newline terminated):
+//   list | stats | enable PATTERN | disable PATTERN | rate PATTERN RECORDS_PER_SECOND (0 is unlimited)
+inline std::string control_command(const std::string& line)
+{
+    if (line == "list")
+    {
+        return list_sites();
+    }
+    if (line == "stats")
+    {
+        return dump_sites();
+    }
+    site_rule rule;
+    if (parse_site_rule(line, rule))
+    {
+        update_config([&rule](config_snapshot& config) { config.runtime_rules.push_back(rule); });
+        return "ok\n";
+    }
+    return "error: unknown command: " + line + "\n";
+}
+
+MY_ASSERT_CONSTINIT inline std::atomic<bool> g_control_socket_started{false};
+
+inline std::string& control_socket_path()
+{
+    static auto* path = new std::string;
+    return *path;
+}
+
+// A client gets this long to send its command and read the response, so a silent one cannot block the others.
+constexpr int control_client_timeout_ms = 1000;
+
+inline void remove_control_socket()
+{
+    if (!control_socket_path().empty()) // cleared in forked children
+    {
+        ::unlink(control_socket_path().c_str());
+    }
+}
+
+// The server thread is not in a forked child, and the child's exit must not remove the parent's socket.
+inline void forget_control_socket_in_child()
+{
+    control_socket_path().clear();
+    g_control_socket_started.store(false, std::memory_order_relaxed);
+}
+
+// accept4 and SOCK_CLOEXEC are Linux extensions: elsewhere the flag is set right after the call.
+#    if defined(__linux__)
+inline int accept_cloexec(int listen_fd)
+{
+    return ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+}
+
+inline int socket_cloexec(int domain, int type)
+{
+    return ::socket(domain, type | SOCK_CLOEXEC, 0);
+}
+#    else
+inline int set_cloexec(int fd)
+{
+    if (fd >= 0)
+    {
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+}
+
+inline int accept_cloexec(int listen_fd)
+{
+    return set_cloexec(::accept(listen_fd, nullptr, nullptr));
+}
+
+inline int socket_cloexec(int domain, int type)
+{
+    return set_cloexec(::socket(domain, type, 0));
+}
+#    endif
+
+inline void serve_control_socket(int listen_fd)
+{
+    while (true)
+    {
+        auto fd = accept_cloexec(listen_fd);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            return;
+        }
+        timeval timeout{control_client_timeout_ms / 1000, control_client_timeout_ms % 1000 * 1000};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        std::string line;
+        char buffer[256];
+        while (line.find('\n') == std::string::npos && line.size() < 4096)
+        {
+            auto count = ::read(fd, buffer, sizeof(buffer));
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count <= 0)
+            {
+                break; // closed, or timed out
+            }
+            line.append(buffer, static_cast<std::size_t>(count));
+        }
+        if (line.find('\n') == std::string::npos)
+        {
+            ::close(fd);
+            continue;
+        }
+        line = line.substr(0, line.find('\n'));
+        auto response = control_command(line);
+        write_all(fd, response.data(), response.size());
+        ::close(fd);
+    }
+}
+} // namespace detail
+
+// Starts a background thread serving a Unix domain socket (default: /tmp/my_assert.<pid>.sock) for
+// tools/my_assert_ctl: list sites, enable/disable MYDEBUG and MYWARNING sites by pattern, change rate limits
+// and dump counters. Returns false if the socket cannot be created. Thread-safe: one call starts the server.
+inline bool start_control_socket(const char* path = nullptr)
+{
+    if (detail::g_control_socket_started.exchange(true, std::memory_order_acq_rel))
+    {
+        return true;
+    }
+    auto failed = [] {
+        detail::g_control_socket_started.store(false, std::memory_order_release);
+        return false;
+    };
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    auto name = path ? std::string(path) : "/tmp/my_assert." + std::to_string(::getpid()) + ".sock";
+    if (name.size() >= sizeof(address.sun_path))
+    {
+        return failed();
+    }
+    std::memcpy(address.sun_path, name.c_str(), name.size() + 1);
+    auto fd = detail::socket_cloexec(AF_UNIX, SOCK_STREAM);
+    if (fd < 0)
+    {
+        return failed();
+    }
+    ::unlink(name.c_str());
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 || ::listen(fd, 8) < 0)
+    {
+        ::close(fd);
+        return failed();
+    }
+    detail::control_socket_path() = name;
+    MY_ASSERT_CONSTINIT static std::atomic<bool> exit_registered{false}; // once, also if a forked child restarts
+    if (!exit_registered.exchange(true, std::memory_order_acq_rel))
+    {
+        std::atexit(detail::remove_control_socket);
+    }
+    detail::set_fork_handlers(detail::fork_slot_control_socket, nullptr, nullptr,
+                              detail::forget_control_socket_in_child);
+    try
+    {
+        std::thread([fd] { detail::serve_control_socket(fd); }).detach();
+    }
+    catch (const std::system_error&)
+    {
+        ::close(fd);
+        ::unlink(name.c_str());
+        detail::control_socket_path().clear();
+        return failed();
+    }
+    return true;
+}
+} // namespace my_assert
+#endif // MY_ASSERT_CONTROL_SOCKET
+
+// --------------------
+// === Scope timers ===
+// --------------------
+namespace my_assert
+{
+namespace detail
+{
+class scope_timer
+{
+public:
+    explicit scope_timer(site_stats& site) : site_(site), start_(std::chrono::steady_clock::now()) {}
+
+    ~scope_timer()
+    {
+        auto elapsed = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+        if (__builtin_expect(!site_.registered.load(std::memory_order_relaxed), 0))
+        {
+            register_site(site_);
+        }
+        site_.hits.fetch_add(1, std::memory_order_relaxed);
+        site_.total_ns.fetch_add(elapsed, std::memory_order_relaxed);
+        update_max(site_.max_ns, elapsed);
+        record_histogram(site_, elapsed);
+    }
+
+    scope_timer(const scope_timer&) = delete;
+    scope_timer& operator=(const scope_timer&) = delete;
+
+private:
+    site_stats& site_;
+    std::chrono::steady_clock::time_point start_;
+};
+} // namespace detail
+} // namespace my_assert
+
+// Measures the enclosing scope: MYTIME("name");
+#define MYTIME(name)                                                                                                   \
+    static my_assert::detail::site_stats CONCAT(my_assert_timer_site_, __LINE__)(                                      \
+        LOCATION, my_assert::detail::site_kind::timer, name);                                                          \
+    my_assert::detail::scope_timer CONCAT(my_assert_timer_, __LINE__)(CONCAT(my_assert_timer_site_, __LINE__))
+
+// --------------------------------
+// === Shared-memory statistics ===
+// --------------------------------
+// Segment /my_assert.<pid> (see shm_open) for external viewers such as tools/my_assert_top.
+// Readers retry while the sequence number is odd or changes during the copy (seqlock).
+#ifdef MY_ASSERT_SHM_STATS
+namespace my_assert
+{
+namespace shm
+{
+constexpr char segment_magic[8] = {'M', 'Y', 'A', 'S', 'H', 'M', '\0', '\0'};
+constexpr std::uint32_t segment_version = 2;
+constexpr std::uint32_t site_capacity = 1024;
+
+struct site_record
+{
+    char location[128];
+    char expr[64];
+    std::uint32_t kind; // detail::site_kind
+    std::uint32_t reserved;
+    std::uint64_t evaluations; // with MY_ASSERT_EVAL_COUNTERS
+    std::uint64_t hits;
+    std::uint64_t suppressed;
+    std::uint64_t contended;
+    std::uint64_t total_ns;
+    std::uint64_t max_ns;
+    std::uint64_t histogram[detail::histogram_buckets];
+};
+
+struct segment
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t capacity;
+    std::int64_t pid;
+    std::atomic<std::uint64_t> sequence;
+    std::uint64_t update_ns; // steady clock
+    std::uint32_t site_count;
+    std::uint32_t reserved;
+    site_record sites[site_capacity];
+};
+
+inline std::string segment_name(std::int64_t pid)
+{
+    return "/my_assert." + std::to_string(pid);
+}
+} // namespace shm
+
+namespace detail
+{
+inline void copy_text(char* dst, std::size_t size, const char* src)
+{
+    std::strncpy(dst, src, size - 1);
+    dst[size - 1] = '\0';
+}
+
+inline void publish_sites(shm::segment& segment)
+{
+    auto sequence = segment.sequence.load(std::memory_order_relaxed);
+    segment.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::uint32_t count = 0;
+    for (auto* site = g_sites.load(std::memory_order_acquire); site && count < shm::site_capacity;
+         site = site->next.load(std::memory_order_relaxed))
+    {
+        auto& record = segment.sites[count++];
+        copy_text(record.location, sizeof(record.location), site->location);
+        copy_text(record.expr, sizeof(record.expr), site->expr);
+        record.kind = static_cast<std::uint32_t>(site->kind);
+        record.evaluations = evaluations(*site);
+        record.hits = site->hits.load(std::memory_order_relaxed);
+        record.suppressed = site->suppressed.load(std::memory_order_relaxed);
+        record.contended = site->contended.load(std::memory_order_relaxed);
+        record.total_ns = site->total_ns.load(std::memory_order_relaxed);
+        record.max_ns = site->max_ns.load(std::memory_order_relaxed);
+        for (int i = 0; i < histogram_buckets; ++i)
+        {
+            record.histogram[i] = site->histogram[i].load(std::memory_order_relaxed);
+        }
+    }
+    segment.site_count = count;
+    segment.update_ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                       std::chrono::steady_clock::now().time_since_epoch())
+                                                       .count());
+    segment.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+inline void remove_shm_stats()
+{
+    ::shm_unlink(shm::segment_name(::getpid()).c_str());
+}
+} // namespace detail
+
+// Starts a background thread copying all site statistics into a shared-memory segment every period.
+// The macros are not involved: the thread only reads their relaxed counters.
+inline bool start_shm_stats(std::chrono::milliseconds period = std::chrono::milliseconds(250))
+{
+    MY_ASSERT_CONSTINIT static std::atomic<bool> started{false};
+    if (started.exchange(true, std::memory_order_acq_rel))
+    {
+        return true;
+    }
+    auto failed = [] {
+        started.store(false, std::memory_order_release);
+        return false;
+    };
+    auto name = shm::segment_name(::getpid());
+    auto fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        return failed();
+    }
+    auto* memory = ::ftruncate(fd, sizeof(shm::segment)) == 0
+                       ? ::mmap(nullptr, sizeof(shm::segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                       : MAP_FAILED;
+    ::close(fd);
+    if (memory == MAP_FAILED)
+    {
+        ::shm_unlink(name.c_str());
+        return failed();
+    }
+    auto* segment = static_cast<shm::segment*>(memory); // zero-filled by ftruncate
+    std::memcpy(segment->magic, shm::segment_magic, sizeof(shm::segment_magic));
+    segment->version = shm::segment_version;
+    segment->capacity = shm::site_capacity;
+    segment->pid = ::getpid();
+    try
+    {
+        std::thread([segment, period] {
+            while (true)
+            {
+                detail::publish_sites(*segment);
+                std::this_thread::sleep_for(period);
+            }
+        }).detach();
+    }
+    catch (const std::system_error&)
+    {
+        ::munmap(memory, sizeof(shm::segment));
+        ::shm_unlink(name.c_str());
+        return failed();
+    }
+    MY_ASSERT_CONSTINIT static std::atomic<bool> exit_registered{false};
+    if (!exit_registered.exchange(true, std::memory_order_acq_rel))
+    {
+        std::atexit(detail::remove_shm_stats);
+    }
+    return true;
+}
+} // namespace my_assert
+#endif // MY_ASSERT_SHM_STATS
+
+// -------------------------
+// === Prometheus export ===
+// -------------------------
+#ifdef MY_ASSERT_PROMETHEUS
+namespace my_assert
+{
+namespace detail
+{
+inline std::string prometheus_label(const char* value)
+{
+    std::string result;
+    for (; *value; ++value)
+    {
+        switch (*value)
+        {
+        case '\\':
+            result += "\\\\";
+            break;
+        case '"':
+            result += "\\\"";
+            break;
+        case '\n':
+            result += "\\n";
+            break;
+        default:
+            result += *value;
+        }
+    }
+    return result;
+}
+
+// Bucket i holds whole nanoseconds in [2^(i-1), 2^i), so its inclusive upper bound is 2^i - 1 ns; the last bucket
+// also holds everything larger and is only counted in +Inf.
+inline void prometheus_histogram(std::ostringstream& oss, const std::string& labels, const site_stats& site,
+                                 std::uint64_t count)
+{
+    oss.precision(12); // whole nanoseconds up to the largest bound
+    std::uint64_t cumulative = 0;
+    for (int i = 0; i < histogram_buckets - 1; ++i)
+    {
+        cumulative += site.histogram[i].load(std::memory_order_relaxed);
+        oss << "my_assert_duration_seconds_bucket{" << labels << ",le=\""
+            << static_cast<double>((1ull << i) - 1) * 1e-9 << "\"} " << cumulative << "\n";
+    }
+    oss << "my_assert_duration_seconds_bucket{" << labels << ",le=\"+Inf\"} " << count << "\n";
+    oss << "my_assert_duration_seconds_sum{" << labels << "} "
+        << static_cast<double>(site.total_ns.load(std::memory_order_relaxed)) * 1e-9 << "\n";
+    oss << "my_assert_duration_seconds_count{" << labels << "} " << count << "\n";
+}
+
+inline std::string prometheus_metrics()
+{
+    std::ostringstream evaluations_text;
+    std::ostringstream failures_text;
+    std::ostringstream warnings_text;
+    std::ostringstream debug_text;
+    std::ostringstream durations_text;
+    for (auto* site = g_sites.load(std::memory_order_acquire); site; site = site->next.load(std::memory_order_relaxed))
+    {
+        auto labels = "location=\"" + prometheus_label(site->location) + "\",expr=\"" + prometheus_label(site->expr) +
+                      "\"";
+        auto hits = site->hits.load(std::memory_order_relaxed);
+        switch (site->kind)
+        {
+        case site_kind::assertion:
+            if (counts_evaluations(*site))
+            {
+                evaluations_text << "my_assert_evaluations_total{" << labels << ",kind=\"assertion\"} "
+                                 << evaluations(*site) << "\n";
+            }
+            failures_text << "my_assert_failures_total{" << labels << "} " << hits << "\n";
+            break;
+        case site_kind::warning:
+            if (counts_evaluations(*site))
+            {
+                evaluations_text << "my_assert_evaluations_total{" << labels << ",kind=\"warning\"} "
+                                 << evaluations(*site) << "\n";
+            }
+            warnings_text << "my_assert_warnings_total{" << labels << "} "
+                          << hits + site->suppressed.load(std::memory_order_relaxed) << "\n";
+            break;
+        case site_kind::debug:
+            debug_text << "my_assert_debug_records_total{" << labels << "} " << hits << "\n";
+            break;
+        case site_kind::timer:
+            prometheus_histogram(durations_text, labels + ",kind=\"timer\"", *site, hits);
+            break;
+        case site_kind::lock:
+            prometheus_histogram(durations_text, labels + ",kind=\"lock_wait\"", *site,
+                                 site->contended.load(std::memory_order_relaxed));
+            break;
+        }
+    }
+    std::ostringstream oss;
+    if (evaluations_text.tellp() > 0) // only sites compiled with MY_ASSERT_EVAL_COUNTERS have evaluations
+    {
+        oss << "# HELP my_assert_evaluations_total Evaluations of MYASSERT/MYWARNING (MY_ASSERT_EVAL_COUNTERS).\n"
+            << "# TYPE my_assert_evaluations_total counter\n"
+            << evaluations_text.str();
+    }
+    oss << "# HELP my_assert_failures_total Failed MYASSERT checks.\n"
+        << "# TYPE my_assert_failures_total counter\n"
+        << failures_text.str() << "# HELP my_assert_warnings_total Failed MYWARNING checks.\n"
+        << "# TYPE my_assert_warnings_total counter\n"
+        << warnings_text.str() << "# HELP my_assert_debug_records_total Printed MYDEBUG records.\n"
+        << "# TYPE my_assert_debug_records_total counter\n"
+        << debug_text.str() << "# HELP my_assert_duration_seconds MYTIME scopes and contended lock waits.\n"
+        << "# TYPE my_assert_duration_seconds histogram\n"
+        << durations_text.str();
+    return oss.str();
+}
+
+MY_ASSERT_CONSTINIT inline std::atomic<bool> g_prometheus_started{false};
+MY_ASSERT_CONSTINIT inline std::mutex g_prometheus_write_mutex; // the export thread and the write at exit
+
+// Writes the metrics to a temporary file in the same directory and renames it over path,
+// so the collector never sees a partial file.
+inline bool write_prometheus_file(const std::string& path)
+{
+    auto metrics = prometheus_metrics();
+    std::lock_guard<std::mutex> lock(g_prometheus_write_mutex);
+    auto temp_path = path + ".tmp." + std::to_string(::getpid());
+    auto fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    auto written = write_all(fd, metrics.data(), metrics.size());
+    ::close(fd);
+    if (written != metrics.size() || std::rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+inline std::string& prometheus_path()
+{
+    static auto* path = new std::string;
+    return *path;
+}
+
+inline void write_final_prometheus_file()
+{
+    if (!prometheus_path().empty()) // cleared in forked children
+    {
+        write_prometheus_file(prometheus_path());
+    }
+}
+
+inline void lock_prometheus_writes()
+{
+    g_prometheus_write_mutex.lock();
+}
+
+inline void unlock_prometheus_writes()
+{
+    g_prometheus_write_mutex.unlock();
+}
+
+// The export thread is not in a forked child, and the child's exit must not overwrite the parent's file.
+inline void forget_prometheus_export_in_child()
+{
+    g_prometheus_write_mutex.unlock();
+    prometheus_path().clear();
+    g_prometheus_started.store(false, std::memory_order_relaxed);
+}
+} // namespace detail
+
+// Starts a background thread rewriting path with all site statistics every period (and once more at exit).
+// Counters are read with relaxed loads, worker threads are never stopped.
+inline void start_prometheus_export(const std::string& path,
+                                    std::chrono::milliseconds period = std::chrono::milliseconds(15000))
+{
+    if (detail::g_prometheus_started.exchange(true, std::memory_order_acq_rel))
+    {
+        return;
+    }
+    detail::prometheus_path() = path;
+    std::thread([path, period] {
+        while (true)
+        {
+            detail::write_prometheus_file(path);
+            std::this_thread::sleep_for(period);
+        }
+    }).detach();
+    std::atexit(detail::write_final_prometheus_file);
+    detail::set_fork_handlers(detail::fork_slot_prometheus, detail::lock_prometheus_writes,
+                              detail::unlock_prometheus_writes, detail::forget_prometheus_export_in_child);
+}
+} // namespace my_assert
+#endif // MY_ASSERT_PROMETHEUS
+
+// --------------------------
+// === Configuration file ===
+// --------------------------
+// One setting per line, '#' starts a comment:
+//   enable PATTERN | disable PATTERN | rate PATTERN N    site rules, same as tools/my_assert_ctl
+//   timestamps on|off
+//   output stderr | output async | output file PATH | output compressed PATH
+// Output is chosen when the file is first loaded; changing it later requires a restart.
+#ifdef MY_ASSERT_CONFIG_FILE
+namespace my_assert
+{
+namespace detail
+{
+inline void config_error(const std::string& location, const std::string& message)
+{
+    std::ostringstream oss;
+    oss << FORMAT_BEGIN(BOLD_CODE) << location << ": " FORMAT_END << MAGENTA_STR("config warning: ") << message
+        << std::endl;
+    emit(oss.str());
+}
+
+inline std::string& config_output()
+{
+    static auto* output = new std::string;
+    return *output;
+}
+
+inline void apply_config_output(const std::string& path, const std::string& output, bool initial)
+{
+    if (!initial)
+    {
+        if (output != config_output())
+        {
+            config_error(path, "output change requires a restart");
+        }
+        return;
+    }
+    config_output() = output;
+    std::istringstream iss(output);
+    std::string kind;
+    std::string file;
+    iss >> kind >> file;
+    if (kind == "async")
+    {
+        enable_async_output();
+    }
+    else if ((kind == "file" || kind == "compressed") && !file.empty())
+    {
+        if (!enable_file_output(file.c_str(), kind == "compressed"))
+        {
+            config_error(path, "cannot open output file " + file + " (or output already enabled)");
+        }
+    }
+    else if (!kind.empty() && kind != "stderr")
+    {
+        config_error(path, "unknown output: " + output);
+    }
+}
+
+inline bool load_config(const std::string& path, bool initial)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        config_error(path, "cannot read config file");
+        return false;
+    }
+    std::vector<site_rule> rules;
+    std::string output = "stderr";
+    std::string line;
+    for (int line_number = 1; std::getline(file, line); ++line_number)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream iss(line);
+        std::string command;
+        if (!(iss >> command))
+        {
+            continue;
+        }
+        site_rule rule;
+        std::string value;
+        if (parse_site_rule(line, rule))
+        {
+            rules.push_back(rule);
+        }
+        else if (command == "timestamps" && (iss >> value) && (value == "on" || value == "off"))
+        {
+            enable_timestamps(value == "on");
+        }
+        else if (command == "output" && std::getline(iss >> std::ws, value))
+        {
+            output = value;
+        }
+        else
+        {
+            config_error(path + ":" + std::to_string(line_number), "cannot parse: " + line);
+        }
+    }
+    update_config([&rules](config_snapshot& config) { config.file_rules = std::move(rules); });
+    apply_config_output(path, output, initial);
+    return true;
+}
+
+#    if defined(__linux__)
+inline void watch_config_loop(int inotify_fd, std::string path, std::string name)
+{
+    alignas(inotify_event) char buffer[4096];
+    while (true)
+    {
+        auto count = ::read(inotify_fd, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return;
+        }
+        auto changed = false;
+        for (auto* position = buffer; position < buffer + count;)
+        {
+            const auto* event = reinterpret_cast<const inotify_event*>(position);
+            changed = changed || (event->len > 0 && name == event->name);
+            position += sizeof(inotify_event) + event->len;
+        }
+        if (changed)
+        {
+            load_config(path, false);
+        }
+    }
+}
+#    else
+constexpr auto config_poll_period = std::chrono::seconds(1);
+
+// Without inotify, the modification time of the file is polled (a replaced file has a new one too).
+inline void poll_config_loop(std::string path, std::filesystem::file_time_type loaded)
+{
+    while (true)
+    {
+        std::this_thread::sleep_for(config_poll_period);
+        std::error_code error;
+        auto modified = std::filesystem::last_write_time(path, error);
+        if (!error && modified != loaded)
+        {
+            loaded = modified;
+            load_config(path, false);
+        }
+    }
+}
+#    endif
+} // namespace detail
+
+// Loads the config file and reloads it from a background thread whenever it changes (inotify on its directory,
+// so editors that replace the file are handled; once a second by modification time on systems other than Linux).
+// Macros only see the resulting per-site flags, without locking.
+inline bool watch_config(const std::string& path)
+{
+#    if defined(__linux__)
+    auto slash = path.rfind('/');
+    auto directory = slash == std::string::npos ? std::string(".") : path.substr(0, slash + 1);
+    auto name = slash == std::string::npos ? path : path.substr(slash + 1);
+    auto fd = ::inotify_init1(IN_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    // Watched before the first load: a change in between is queued and triggers a reload.
+    if (::inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+    {
+        detail::config_error(path, std::string("cannot watch config directory: ") + std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    if (!detail::load_config(path, true))
+    {
+        ::close(fd);
+        return false;
+    }
+    std::thread(detail::watch_config_loop, fd, path, name).detach();
+    return true;
+#    else
+    std::error_code error;
+    auto modified = std::filesystem::last_write_time(path, error); // before the first load, as the watch above
+    if (!detail::load_config(path, true))
+    {
+        return false;
+    }
+    std::thread(detail::poll_config_loop, path, modified).detach();
+    return true;
+#    endif
+}
+} // namespace my_assert
+#endif // MY_ASSERT_CONFIG_FILE
+
+// -------------------
+// === Graph dumps ===
+// -------------------
+// MYDEBUG_GRAPH copies a graph into a snapshot taken from a per-thread pool and queues it; a background thread
+// formats it as a Graphviz DOT file named after the site and a sequence number. The caller only pays for the copy.
+#ifdef MY_ASSERT_GRAPHS
+namespace my_assert
+{
+namespace detail
+{
+struct graph_arena;
+
+struct graph_snapshot
+{
+    graph_arena* arena = nullptr;
+    graph_snapshot* next = nullptr; // in the returned list of the arena
+    const site_stats* site = nullptr;
+    std::uint64_t sequence = 0;
+    std::vector<std::uint64_t> offsets; // edges of node v are [offsets[v], offsets[v + 1]) (CSR)
+    std::vector<std::uint64_t> targets;
+    std::vector<double> weights; // parallel to targets, empty for unweighted graphs
+};
+
+// Snapshots of one thread. They keep their buffers, so repeated dumps of similar graphs do not allocate.
+// The writer hands snapshots back through a lock-free list; the arena is freed by the last of its thread and
+// the snapshots still queued.
+struct graph_arena
+{
+    std::vector<graph_snapshot*> free; // owner thread only
+    std::atomic<graph_snapshot*> returned{nullptr};
+    std::atomic<std::size_t> references{1};
+
+    graph_snapshot* acquire()
+    {
+        if (free.empty())
+        {
+            for (auto* snapshot = returned.exchange(nullptr, std::memory_order_acquire); snapshot;
+                 snapshot = snapshot->next)
+            {
+                free.push_back(snapshot);
+            }
+        }
+        references.fetch_add(1, std::memory_order_relaxed);
+        if (free.empty())
+        {
+            auto* snapshot = new graph_snapshot;
+            snapshot->arena = this;
+            return snapshot;
+        }
+        auto* snapshot = free.back();
+        free.pop_back();
+        return snapshot;
+    }
+
+    void release(graph_snapshot* snapshot)
+    {
+        auto* head = returned.load(std::memory_order_relaxed);
+        do
+        {
+            snapshot->next = head;
+        } while (!returned.compare_exchange_weak(head, snapshot, std::memory_order_release, std::memory_order_relaxed));
+        unreference();
+    }
+
+    void unreference()
+    {
+        if (references.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        {
+            return;
+        }
+        for (auto* snapshot : free)
+        {
+            delete snapshot;
+        }
+        for (auto* snapshot = returned.load(std::memory_order_acquire); snapshot;)
+        {
+            delete std::exchange(snapshot, snapshot->next);
+        }
+        delete this;
+    }
+};
+
+struct graph_arena_owner
+{
+    graph_arena* arena = nullptr;
+
+    ~graph_arena_owner()
+    {
+        if (arena)
+        {
+            arena->unreference();
+        }
+    }
+};
+
+inline graph_arena& thread_graph_arena()
+{
+    static thread_local graph_arena_owner owner;
+    if (!owner.arena)
+    {
+        owner.arena = new graph_arena;
+    }
+    return *owner.arena;
+}
+
+inline std::string& graph_directory()
+{
+    static auto* directory = new std::string(".");
+    return *directory;
+}
+
+MY_ASSERT_CONSTINIT inline std::atomic<std::uint64_t> g_graph_sequence{0};
+
+// "<directory>/<file>_<line>_<sequence>.dot"
+inline std::string graph_file_name(const graph_snapshot& snapshot)
+{
+    std::string_view location = snapshot.site->location;
+    location = location.substr(location.find_last_of('/') + 1);
+    auto name = graph_directory() + "/";
+    for (auto c : location)
+    {
+        name += c == ':' ? '_' : c;
+    }
+    name += '_';
+    append_cell(name, snapshot.sequence);
+    name += ".dot";
+    return name;
+}
+
+inline void write_graph(const graph_snapshot& snapshot)
+{
+    auto nodes = snapshot.offsets.size() - 1;
+    std::string dot = "digraph \"";
+    dot += snapshot.site->location;
+    dot += " #";
+    append_cell(dot, snapshot.sequence);
+    dot += "\" {\n";
+    for (std::size_t v = 0; v < nodes; ++v)
+    {
+        dot += "  ";
+        append_cell(dot, v);
+        dot += ";\n";
+    }
+    for (std::size_t v = 0; v < nodes; ++v)
+    {
+        for (auto e = snapshot.offsets[v]; e < snapshot.offsets[v + 1]; ++e)
+        {
+            dot += "  ";
+            append_cell(dot, v);
+            dot += " -> ";
+            append_cell(dot, snapshot.targets[e]);
+            if (!snapshot.weights.empty())
+            {
+                dot += " [label=\"";
+                append_cell(dot, snapshot.weights[e]);
+                dot += "\"]";
+            }
+            dot += ";\n";
+        }
+    }
+    dot += "}\n";
+
+    auto path = graph_file_name(snapshot);
+    auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    auto written = fd >= 0 && write_all(fd, dot.data(), dot.size()) == dot.size();
+    auto error = errno; // of the failed call: close and the report below may change errno
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+    std::ostringstream oss;
+    oss << FORMAT_BEGIN(BOLD_CODE) << snapshot.site->location << ": " << FORMAT_END;
+    if (written)
+    {
+        oss << YELLOW_STR("debug: ") << snapshot.site->expr << " -> " << path << " (" << nodes << " nodes, "
+            << snapshot.targets.size() << " edges)" << std::endl;
+    }
+    else
+    {
+        oss << MAGENTA_STR("warning: ") << "cannot write graph " << snapshot.site->expr << " to " << path << ": "
+            << std::strerror(error) << std::endl;
+    }
+    emit(oss.str());
+}
+
+class graph_writer
+{
+public:
+    static constexpr std::size_t queue_capacity = 64;
+
+    void start()
+    {
+        thread_ = std::thread([this] { run(); });
+    }
+
+    // Returns false, counting the snapshot as dropped, if the queue is full or the writer stopped.
+    bool push(graph_snapshot* snapshot)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_ || queue_.size() >= queue_capacity)
+        {
+            ++dropped_;
+            return false;
+        }
+        queue_.push_back(snapshot);
+        cv_.notify_one();
+        return true;
+    }
+
+    // Writes the queued snapshots and joins the thread.
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+    }
+
+private:
+    void run()
+    {
+        std::vector<graph_snapshot*> batch;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            cv_.wait(lock, [this] { return stop_ || !queue_.empty() || dropped_ > 0; });
+            batch.swap(queue_);
+            auto dropped = std::exchange(dropped_, 0);
+            auto stop = stop_;
+            lock.unlock();
+            for (auto* snapshot : batch)
+            {
+                write_graph(*snapshot);
+                snapshot->arena->release(snapshot);
+            }
+            batch.clear();
+            if (dropped > 0)
+            {
+                std::ostringstream oss;
+                oss << MAGENTA_STR("warning: ") << dropped << " graph dumps dropped (writer queue full)" << std::endl;
+                emit(oss.str());
+            }
+            if (stop)
+            {
+                return;
+            }
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<graph_snapshot*> queue_;
+    std::size_t dropped_ = 0;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+MY_ASSERT_CONSTINIT inline std::atomic<graph_writer*> g_graph_writer{nullptr};
+
+// Queued snapshots are written by the parent; a forked child starts its own writer on its first dump.
+inline void forget_graph_writer_in_child()
+{
+    g_graph_writer.store(nullptr, std::memory_order_relaxed);
+}
+
+inline void stop_graph_writer()
+{
+    if (auto* writer = g_graph_writer.load(std::memory_order_acquire))
+    {
+        writer->stop();
+    }
+}
+
+// Started by the first dump (again in a forked child); never freed.
+inline graph_writer& get_graph_writer()
+{
+    auto* writer = g_graph_writer.load(std::memory_order_acquire);
+    if (__builtin_expect(writer != nullptr, 1))
+    {
+        return *writer;
+    }
+    auto* created = new graph_writer;
+    if (!g_graph_writer.compare_exchange_strong(writer, created, std::memory_order_acq_rel))
+    {
+        delete created;
+        return *writer;
+    }
+    created->start();
+    MY_ASSERT_CONSTINIT static std::atomic<bool> registered{false};
+    if (!registered.exchange(true, std::memory_order_relaxed))
+    {
+        std::atexit(stop_graph_writer);
+    }
+    set_fork_handlers(fork_slot_graph_writer, nullptr, nullptr, forget_graph_writer_in_child);
+    return *created;
+}
+
+template <typename T, typename = void>
+struct is_tuple_like : std::false_type
+{
+};
+
+template <typename T>
+struct is_tuple_like<T, std::void_t<decltype(std::tuple_size<T>::value)>> : std::true_type
+{
+};
+
+// Adjacency list: a container of edge lists whose elements are targets or (target, weight) pairs.
+template <typename Graph>
+void snapshot_graph(graph_snapshot& snapshot, const Graph& graph)
+{
+    snapshot.offsets.assign(1, 0);
+    snapshot.targets.clear();
+    snapshot.weights.clear();
+    for (const auto& edges : graph)
+    {
+        for (const auto& edge : edges)
+        {
+            using edge_type = std::decay_t<decltype(edge)>;
+            if constexpr (is_tuple_like<edge_type>::value)
+            {
+                static_assert(std::is_arithmetic_v<std::decay_t<std::tuple_element_t<1, edge_type>>>,
+                              "MYDEBUG_GRAPH edge weights must be numbers");
+                snapshot.targets.push_back(static_cast<std::uint64_t>(std::get<0>(edge)));
+                snapshot.weights.push_back(static_cast<double>(std::get<1>(edge)));
+            }
+            else
+            {
+                snapshot.targets.push_back(static_cast<std::uint64_t>(edge));
+            }
+        }
+        snapshot.offsets.push_back(snapshot.targets.size());
+    }
+}
+
+// CSR: edges of node v are targets[offsets[v]], ..., targets[offsets[v + 1] - 1].
+template <typename Offsets, typename Targets>
+void snapshot_graph(graph_snapshot& snapshot, const Offsets& offsets, const Targets& targets, std::size_t nodes)
+{
+    auto base = static_cast<std::uint64_t>(offsets[0]);
+    snapshot.offsets.resize(nodes + 1);
+    for (std::size_t v = 0; v <= nodes; ++v)
+    {
+        snapshot.offsets[v] = static_cast<std::uint64_t>(offsets[v]) - base;
+    }
+    snapshot.targets.resize(snapshot.offsets[nodes]);
+    for (std::size_t e = 0; e < snapshot.targets.size(); ++e)
+    {
+        snapshot.targets[e] = static_cast<std::uint64_t>(targets[base + e]);
+    }
+    snapshot.weights.clear();
+}
+
+template <typename... Graph>
+void dump_graph(site_stats& site, const Graph&... graph)
+{
+    auto& arena = thread_graph_arena();
+    auto* snapshot = arena.acquire();
+    snapshot->site = &site;
+    snapshot->sequence = g_graph_sequence.fetch_add(1, std::memory_order_relaxed);
+    snapshot_graph(*snapshot, graph...);
+    if (!get_graph_writer().push(snapshot))
+    {
+        arena.release(snapshot);
+    }
+}
+} // namespace detail
+
+// Directory for MYDEBUG_GRAPH files (default: current directory). Set it before the first dump.
+inline void set_graph_directory(const char* directory)
+{
+    detail::graph_directory() = directory;
+}
+} // namespace my_assert
+#endif // MY_ASSERT_GRAPHS
+
+// --------------------------
+// === Argument recording ===
+// --------------------------
+// MYRECORD_ARGS copies trivially copyable arguments into a per-thread ring of the last calls. When the first
+// MyAssertException of the process is thrown (or a later one terminates the thread, or
+// my_assert::dump_recorded_args() is called), the ring is written to "<directory>/my_assert_args.<pid>.<n>.bin"; a
+// debug build reads it with my_assert::recorded_calls and calls the function again with each recorded argument list.
+#ifdef MY_ASSERT_RECORD_ARGS
+namespace my_assert
+{
+namespace detail
+{
+template <typename... Args>
+constexpr std::string_view args_type_list()
+{
+    return __PRETTY_FUNCTION__;
+}
+
+// FNV-1a of the argument types as the compiler names them: replay only calls functions taking the same types.
+template <typename... Args>
+constexpr std::uint64_t args_signature()
+{
+    std::uint64_t hash = 14695981039346656037ull;
+    for (auto c : args_type_list<Args...>())
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+template <typename... Args>
+constexpr std::array<std::size_t, sizeof...(Args) + 1> args_offsets()
+{
+    std::array<std::size_t, sizeof...(Args) + 1> offsets{};
+    std::size_t sizes[] = {sizeof(Args)..., 0};
+    for (std::size_t i = 0; i < sizeof...(Args); ++i)
+    {
+        offsets[i + 1] = offsets[i] + sizes[i];
+    }
+    return offsets;
+}
+
+struct args_record
+{
+    static constexpr std::size_t payload_capacity = 256;
+
+    const char* location;
+    std::uint64_t signature;
+    std::uint32_t size;
+    char payload[payload_capacity];
+};
+
+struct args_ring
+{
+    static constexpr std::size_t capacity = 64;
+
+    std::uint64_t head = 0;
+    std::uint64_t dumped_head = 0; // head at the last dump: the same calls are not written twice
+    args_record records[capacity];
+};
+
+MY_ASSERT_CONSTINIT inline thread_local args_ring* t_args_ring = nullptr;
+MY_ASSERT_CONSTINIT inline thread_local bool t_args_replaying = false; // failures of replayed calls are not dumped
+
+struct args_ring_owner
+{
+    constexpr args_ring_owner() = default;
+
+    ~args_ring_owner()
+    {
+        delete t_args_ring;
+        t_args_ring = nullptr;
+    }
+};
+
+inline std::string& record_directory()
+{
+    static auto* directory = new std::string(".");
+    return *directory;
+}
+
+MY_ASSERT_CONSTINIT inline std::atomic<std::uint64_t> g_args_dump_sequence{0};
+
+// File: "MYARGS1\n", then for each call from oldest to newest: u32 location length, location, u64 signature,
+// u32 payload size, payload (arguments packed in order, host byte order).
+inline void write_recorded_args()
+{
+    auto* ring = t_args_ring;
+    if (!ring || ring->head == ring->dumped_head || t_args_replaying)
+    {
+        return;
+    }
+    ring->dumped_head = ring->head;
+    auto first = ring->head > args_ring::capacity ? ring->head - args_ring::capacity : 0;
+    std::string data = "MYARGS1\n";
+    auto put = [&data](const void* value, std::size_t size) {
+        data.append(static_cast<const char*>(value), size);
+    };
+    for (auto i = first; i < ring->head; ++i)
+    {
+        const auto& record = ring->records[i % args_ring::capacity];
+        auto length = static_cast<std::uint32_t>(std::strlen(record.location));
+        put(&length, sizeof(length));
+        put(record.location, length);
+        put(&record.signature, sizeof(record.signature));
+        put(&record.size, sizeof(record.size));
+        put(record.payload, record.size);
+    }
+
+    auto path = record_directory() + "/my_assert_args." + std::to_string(::getpid()) + "." +
+                std::to_string(g_args_dump_sequence.fetch_add(1, std::memory_order_relaxed)) + ".bin";
+    auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    auto written = fd >= 0 && write_all(fd, data.data(), data.size()) == data.size();
+    auto error = errno; // of the failed call: close and the report below may change errno
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+    std::ostringstream oss;
+    oss << FORMAT_BEGIN(BOLD_CODE) << ring->records[(ring->head - 1) % args_ring::capacity].location << ": "
+        << FORMAT_END;
+    if (written)
+    {
+        oss << YELLOW_STR("debug: ") << "arguments of the last " << ring->head - first << " recorded calls written to "
+            << path << std::endl;
+    }
+    else
+    {
+        oss << MAGENTA_STR("warning: ") << "cannot write recorded arguments to " << path << ": "
+            << std::strerror(error) << std::endl;
+    }
+    emit_failure(oss.str());
+}
+
+MY_ASSERT_CONSTINIT inline std::atomic<bool> g_args_written_on_throw{false};
+
+// The ring is written where the failure is raised, before unwinding or a catch can lose it, but only by the first
+// MyAssertException that finds recorded calls: a stress loop catching failures does not write a file per case.
+inline void write_recorded_args_on_throw()
+{
+    auto* ring = t_args_ring;
+    if (!ring || ring->head == ring->dumped_head || t_args_replaying ||
+        g_args_written_on_throw.exchange(true, std::memory_order_relaxed))
+    {
+        return;
+    }
+    try
+    {
+        write_recorded_args();
+    }
+    catch (...)
+    {
+        // Out of memory: the exception being constructed is still thrown.
+    }
+}
+
+MY_ASSERT_CONSTINIT inline std::atomic<bool> g_args_terminate_installed{false};
+MY_ASSERT_CONSTINIT inline std::atomic<std::terminate_handler> g_args_previous_terminate{nullptr};
+
+// Backstop for later failures: an uncaught MyAssertException reaches std::terminate on the thread that threw it,
+// whose ring is still there (and is not written again if nothing was recorded since the last file).
+[[noreturn]] inline void terminate_writing_args()
+{
+    if (auto exception = std::current_exception())
+    {
+        try
+        {
+            std::rethrow_exception(exception);
+        }
+        catch (const MyAssertException&)
+        {
+            write_recorded_args();
+        }
+        catch (...)
+        {
+        }
+    }
+    if (auto previous = g_args_previous_terminate.load(std::memory_order_relaxed))
+    {
+        previous();
+    }
+    std::abort();
+}
+
+[[gnu::noinline, gnu::cold]] inline args_ring& create_thread_args_ring()
+{
+    static thread_local args_ring_owner owner;
+    (void)owner;
+    t_args_ring = new args_ring;
+    if (!g_args_terminate_installed.exchange(true, std::memory_order_relaxed))
+    {
+        g_args_previous_terminate.store(std::set_terminate(terminate_writing_args), std::memory_order_relaxed);
+        g_assert_exception_hook.store(write_recorded_args_on_throw, std::memory_order_relaxed);
+    }
+    return *t_args_ring;
+}
+
+inline args_ring& thread_args_ring()
+{
+    return __builtin_expect(t_args_ring != nullptr, 1) ? *t_args_ring : create_thread_args_ring();
+}
+
+template <typename... Args>
+void record_args(const char* location, const Args&... args)
+{
+    static_assert((std::is_trivially_copyable_v<Args> && ...), "MYRECORD_ARGS records trivially copyable arguments");
+    static_assert(!(std::is_pointer_v<Args> || ...), "MYRECORD_ARGS cannot replay pointers: record the values");
+    constexpr auto offsets = args_offsets<Args...>();
+    static_assert(offsets.back() <= args_record::payload_capacity, "MYRECORD_ARGS arguments exceed 256 bytes");
+    constexpr auto signature = args_signature<Args...>();
+    auto& ring = thread_args_ring();
+    auto& record = ring.records[ring.head++ % args_ring::capacity];
+    record.location = location;
+    record.signature = signature;
+    record.size = static_cast<std::uint32_t>(offsets.back());
+    auto* out = record.payload;
+    ((std::memcpy(out, &args, sizeof(Args)), out += sizeof(Args)), ...);
+}
+
+template <typename T>
+T load_arg(const char* data)
+{
+    T value;
+    std::memcpy(static_cast<void*>(&value), data, sizeof(T));
+    return value;
+}
+} // namespace detail
+
+// Directory for files of MYRECORD_ARGS (default: current directory).
+inline void set_record_directory(const char* directory)
+{
+    detail::record_directory() = directory;
+}
+
+// Writes the calls recorded by this thread since the last file, e.g. from the handler of a caught failure after
+// the first one (which writes them when it is thrown).
+inline void dump_recorded_args()
+{
+    detail::write_recorded_args();
+}
+
+// Calls read from a file written for MYRECORD_ARGS, for replay in a debug build:
+//    `my_assert::recorded_calls calls("my_assert_args.1234.0.bin");`
+//    `calls.replay(solve);` (or `calls.replay_with<Input, int>(lambda)`)
+class recorded_calls
+{
+public:
+    struct call
+    {
+        std::string location;
+        std::uint64_t signature;
+        std::string payload;
+    };
+
+    explicit recorded_calls(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file.good() && !file.eof())
+        {
+            throw std::runtime_error("my_assert: cannot read " + path);
+        }
+        if (data.compare(0, 8, "MYARGS1\n") != 0)
+        {
+            throw std::runtime_error("my_assert: " + path + " is not a file of recorded arguments");
+        }
+        std::size_t position = 8;
+        auto take = [&](void* value, std::size_t size) {
+            if (data.size() - position < size)
+            {
+                throw std::runtime_error("my_assert: " + path + " is truncated");
+            }
+            std::memcpy(value, data.data() + position, size);
+            position += size;
+        };
+        while (position < data.size())
+        {
+            call recorded;
+            std::uint32_t size = 0;
+            take(&size, sizeof(size));
+            recorded.location.resize(size);
+            take(recorded.location.data(), size);
+            take(&recorded.signature, sizeof(recorded.signature));
+            take(&size, sizeof(size));
+            recorded.payload.resize(size);
+            take(recorded.payload.data(), size);
+            calls_.push_back(std::move(recorded));
+        }
+    }
+
+    // Oldest first; the last one is usually the call that failed.
+    const std::vector<call>& calls() const
+    {
+        return calls_;
+    }
+
+    // Calls function with every recorded argument list of its parameter types (only those recorded at location,
+    // "file.cpp:42", if given). Returns the number of calls made.
+    template <typename R, typename... P>
+    std::size_t replay(R (*function)(P...), std::string_view location = {}) const
+    {
+        return replay_with<std::decay_t<P>...>(function, location);
+    }
+
+    template <typename... Args, typename F>
+    std::size_t replay_with(F&& function, std::string_view location = {}) const
+    {
+        struct replaying_guard
+        {
+            bool previous = std::exchange(detail::t_args_replaying, true);
+
+            ~replaying_guard()
+            {
+                detail::t_args_replaying = previous;
+            }
+        } guard;
+        constexpr auto signature = detail::args_signature<Args...>();
+        std::size_t replayed = 0;
+        for (const auto& recorded : calls_)
+        {
+            if (recorded.signature == signature &&
+                (location.empty() || recorded.location == location))
+            {
+                call_with<Args...>(function, recorded.payload.data(), std::index_sequence_for<Args...>{});
+                ++replayed;
+            }
+        }
+        return replayed;
+    }
+
+private:
+    template <typename... Args, typename F, std::size_t... I>
+    static void call_with(F& function, const char* payload, std::index_sequence<I...>)
+    {
+        constexpr auto offsets = detail::args_offsets<Args...>();
+        std::tuple<Args...> args{detail::load_arg<Args>(payload + offsets[I])...};
+        std::apply(function, args);
+    }
+
+    std::vector<call> calls_;
+};
+} // namespace my_assert
+#endif // MY_ASSERT_RECORD_ARGS
+
+// ------------------------------
+// === Background check pools ===
+// ------------------------------
+// Checks too slow for the calling thread (MYSHADOW, MYASSERT_ASYNC) are queued as jobs to a pool of worker threads.
+// Queues are bounded: when full, jobs are dropped and the count is reported. An exception thrown by a job is reported
+// as a failure of its site; the worker goes on with the next job.
+#ifdef MY_ASSERT_BACKGROUND_CHECKS
+namespace my_assert
+{
+namespace detail
+{
+struct check_job
+{
+    virtual ~check_job() = default;
+    virtual void run() = 0;
+    // Called with what() (nullptr for an exception not derived from std::exception) when run() throws.
+    virtual void report_exception(const char* what) = 0;
+};
+
+inline const char* exception_text(const char* what)
+{
+    return what ? what : "unknown exception";
+}
+
+class check_pool
+{
+public:
+    static constexpr std::size_t queue_capacity = 256;
+
+    // idle: workers run at SCHED_IDLE, using only otherwise idle CPU time (Linux; normal priority elsewhere).
+    check_pool(const char* name, bool idle) : name_(name), idle_(idle)
+    {
+    }
+
+    void start(unsigned workers)
+    {
+        for (unsigned i = 0; i < workers; ++i)
+        {
+            std::thread([this] { run(); }).detach();
+        }
+    }
+
+    // Returns false, counting the job as dropped, if the queue is full.
+    bool push(check_job* job)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.size() >= queue_capacity)
+        {
+            ++dropped_;
+            return false;
+        }
+        queue_.push_back(job);
+        ++pending_;
+        cv_.notify_one();
+        return true;
+    }
+
+    void wait_idle()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_cv_.wait(lock, [this] { return pending_ == 0; });
+    }
+
+private:
+    void run()
+    {
+#    if defined(__linux__)
+        if (idle_)
+        {
+            sched_param param{};
+            ::pthread_setschedparam(::pthread_self(), SCHED_IDLE, &param);
+        }
+#    endif
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            cv_.wait(lock, [this] { return !queue_.empty() || dropped_ > 0; });
+            auto dropped = std::exchange(dropped_, 0);
+            check_job* job = nullptr;
+            if (!queue_.empty())
+            {
+                job = queue_.front();
+                queue_.pop_front();
+            }
+            lock.unlock();
+            if (dropped > 0)
+            {
+                std::ostringstream oss;
+                oss << MAGENTA_STR("warning: ") << dropped << " " << name_ << " dropped (queue full)" << std::endl;
+                emit(oss.str());
+            }
+            if (job)
+            {
+                try
+                {
+                    job->run();
+                }
+                catch (const std::exception& e)
+                {
+                    job->report_exception(e.what());
+                }
+                catch (...)
+                {
+                    job->report_exception(nullptr);
+                }
+                delete job;
+            }
+            lock.lock();
+            if (job && --pending_ == 0)
+            {
+                idle_cv_.notify_all();
+            }
+        }
+    }
+
+    const char* name_;
+    bool idle_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable idle_cv_;
+    std::deque<check_job*> queue_;
+    std::size_t pending_ = 0; // queued or running
+    std::size_t dropped_ = 0;
+};
+
+MY_ASSERT_CONSTINIT inline std::atomic<check_pool*> g_shadow_pool{nullptr};
+MY_ASSERT_CONSTINIT inline std::atomic<check_pool*> g_validation_pool{nullptr};
+
+#    ifdef MY_ASSERT_HAS_FORK_HANDLERS
+// The workers are not in a forked child: its pools start on first use.
+inline void forget_check_pools_in_child()
+{
+    g_shadow_pool.store(nullptr, std::memory_order_relaxed);
+    g_validation_pool.store(nullptr, std::memory_order_relaxed);
+}
+#    endif
+
+// Started on first use with the given number of workers (again in a forked child); never freed.
+inline check_pool& get_check_pool(std::atomic<check_pool*>& pool, const char* name, bool idle, unsigned workers)
+{
+    auto* current = pool.load(std::memory_order_acquire);
+    if (__builtin_expect(current != nullptr, 1))
+    {
+        return *current;
+    }
+    auto* created = new check_pool(name, idle);
+    if (!pool.compare_exchange_strong(current, created, std::memory_order_acq_rel))
+    {
+        delete created;
+        return *current;
+    }
+    created->start(workers);
+#    ifdef MY_ASSERT_HAS_FORK_HANDLERS
+    set_fork_handlers(fork_slot_check_pools, nullptr, nullptr, forget_check_pools_in_child);
+#    endif
+    return *created;
+}
+
+inline void wait_check_pool(const std::atomic<check_pool*>& pool)
+{
+    if (auto* current = pool.load(std::memory_order_acquire))
+    {
+        current->wait_idle();
+    }
+}
+} // namespace detail
+} // namespace my_assert
+#endif // MY_ASSERT_BACKGROUND_CHECKS
+
+// ---------------------
+// === Shadow checks ===
+// ---------------------
+// MYSHADOW compares a fast result with a reference implementation on a sampled fraction of calls. The caller only
+// copies the inputs and the result into a job; one idle-priority worker runs the reference and reports mismatches
+// like failed assertions (without throwing: the call that produced the result has returned).
+#ifdef MY_ASSERT_BACKGROUND_CHECKS
+namespace my_assert
+{
+namespace detail
+{
+MY_ASSERT_CONSTINIT inline thread_local std::uint64_t t_shadow_random = 0x9e3779b97f4a7c15ull;
+
+inline bool shadow_sampled(double rate)
+{
+    t_shadow_random ^= t_shadow_random << 13;
+    t_shadow_random ^= t_shadow_random >> 7;
+    t_shadow_random ^= t_shadow_random << 17;
+    return static_cast<double>(t_shadow_random >> 11) * 0x1.0p-53 < rate;
+}
+
+// MYSHADOW(rate, (a, b), ...): copies of the inputs.
+template <typename... Inputs>
+std::tuple<std::decay_t<Inputs>...> shadow_inputs(const Inputs&... inputs)
+{
+    return std::tuple<std::decay_t<Inputs>...>(inputs...);
+}
+
+template <typename... Values>
+void print_shadow_inputs(std::ostream& os, const Values&... values)
+{
+    auto first = true;
+    ((os << (first ? "" : ", ") << printable(values), first = false), ...);
+}
+
+template <typename Inputs, typename Result, typename Reference>
+struct shadow_job final : check_job
+{
+    site_stats* site = nullptr;
+    const char* inputs_text = "";
+    const char* result_text = "";
+    const char* reference_text = "";
+    Inputs inputs;
+    Result result;
+    Reference reference;
+
+    shadow_job(Inputs inputs_, Result result_, Reference reference_)
+        : inputs(std::move(inputs_)), result(std::move(result_)), reference(std::move(reference_))
+    {
+    }
+
+    void run() override
+    {
+        auto expected = std::apply(reference, inputs);
+        if (expected == result)
+        {
+            return;
+        }
+        site_failed(*site);
+        std::ostringstream oss;
+        oss << FORMAT_BEGIN(BOLD_CODE) << site->location << ": " << FORMAT_END << RED_STR("shadow check failed: ")
+            << result_text << " = " << printable(result) << ", " << reference_text << inputs_text << " = "
+            << printable(expected) << " for " << inputs_text << " = (";
+        std::apply([&oss](const auto&... values) { print_shadow_inputs(oss, values...); }, inputs);
+        oss << ")" << std::endl;
+        emit_failure(oss.str());
+    }
+
+    void report_exception(const char* what) override
+    {
+        site_failed(*site);
+        std::ostringstream oss;
+        oss << FORMAT_BEGIN(BOLD_CODE) << site->location << ": " << FORMAT_END << RED_STR("shadow check failed: ")
+            << reference_text << inputs_text << " threw " << exception_text(what) << " for " << inputs_text << " = (";
+        std::apply([&oss](const auto&... values) { print_shadow_inputs(oss, values...); }, inputs);
+        oss << ")" << std::endl;
+        emit_failure(oss.str());
+    }
+};
+
+template <typename Inputs, typename Result, typename Reference>
+[[gnu::noinline]] void submit_shadow(site_stats& site, const char* inputs_text, const char* result_text,
+                                     const char* reference_text, Inputs inputs, const Result& result,
+                                     Reference reference)
+{
+    auto* job = new shadow_job<Inputs, Result, Reference>(std::move(inputs), result, std::move(reference));
+    job->site = &site;
+    job->inputs_text = inputs_text;
+    job->result_text = result_text;
+    job->reference_text = reference_text;
+    if (!get_check_pool(g_shadow_pool, "shadow checks", true, 1).push(job))
+    {
+        delete job;
+    }
+}
+} // namespace detail
+
+// Waits until all queued MYSHADOW checks have run (e.g. at the end of a test).
+inline void wait_shadow_checks()
+{
+    detail::wait_check_pool(detail::g_shadow_pool);
+}
+} // namespace my_assert
+#endif // MY_ASSERT_BACKGROUND_CHECKS
+
+// -----------------------------------------
+// === Asynchronous invariant validation ===
+// -----------------------------------------
+// MYASSERT_ASYNC(object, validator) takes a snapshot of object and checks validator(snapshot) on a worker pool, so
+// deep invariants (full index consistency, ...) run continuously off the critical path. The snapshot is a copy into
+// a recycled buffer (copy assignment reuses the capacity of containers), or, for a std::shared_ptr<const T>
+// (a copy-on-write version kept by the caller), the pointer itself. Failures name the site and the sequence number
+// of the snapshot at that site.
+#ifdef MY_ASSERT_BACKGROUND_CHECKS
+namespace my_assert
+{
+namespace detail
+{
+// Recycled snapshot buffers of one type. Workers push returned buffers; takers detach the whole list, keep the
+// first node and put the rest back, so the list has no ABA problem and no lock (safe across fork).
+template <typename T>
+struct pooled_snapshot
+{
+    T value;
+    pooled_snapshot* next = nullptr;
+};
+
+template <typename T>
+MY_ASSERT_CONSTINIT inline std::atomic<pooled_snapshot<T>*> g_snapshot_pool{nullptr};
+
+template <typename T>
+void push_snapshots(pooled_snapshot<T>* first, pooled_snapshot<T>* last)
+{
+    auto* head = g_snapshot_pool<T>.load(std::memory_order_relaxed);
+    do
+    {
+        last->next = head;
+    } while (!g_snapshot_pool<T>.compare_exchange_weak(head, first, std::memory_order_release,
+                                                        std::memory_order_relaxed));
+}
+
+template <typename T>
+pooled_snapshot<T>* take_snapshot(const T& object)
+{
+    auto* node = g_snapshot_pool<T>.exchange(nullptr, std::memory_order_acquire);
+    if (!node)
+    {
+        return new pooled_snapshot<T>{object};
+    }
+    if (auto* rest = node->next)
+    {
+        auto* last = rest;
+        while (last->next)
+        {
+            last = last->next;
+        }
+        push_snapshots(rest, last);
+    }
+    node->next = nullptr;
+    node->value = object;
+    return node;
+}
+
+template <typename T>
+const T& snapshot_value(const pooled_snapshot<T>* snapshot)
+{
+    return snapshot->value;
+}
+
+template <typename T>
+const T& snapshot_value(const std::shared_ptr<const T>& snapshot)
+{
+    return *snapshot;
+}
+
+template <typename T>
+void release_snapshot(pooled_snapshot<T>*& snapshot)
+{
+    if (snapshot)
+    {
+        push_snapshots(snapshot, snapshot);
+        snapshot = nullptr;
+    }
+}
+
+template <typename T>
+void release_snapshot(std::shared_ptr<const T>& snapshot)
+{
+    snapshot.reset();
+}
+
+template <typename T>
+pooled_snapshot<T>* make_snapshot(const T& object)
+{
+    return take_snapshot(object);
+}
+
+template <typename T>
+std::shared_ptr<const T> make_snapshot(const std::shared_ptr<const T>& version)
+{
+    return version;
+}
+
+template <typename T>
+std::shared_ptr<const T> make_snapshot(const std::shared_ptr<T>& version)
+{
+    return version;
+}
+
+template <typename Snapshot, typename Validator>
+struct validation_job final : check_job
+{
+    site_stats* site = nullptr;
+    const char* validator_text = "";
+    const char* object_text = "";
+    std::uint64_t sequence = 0;
+    Snapshot snapshot;
+    Validator validator;
+
+    validation_job(Snapshot snapshot_, Validator validator_)
+        : snapshot(std::move(snapshot_)), validator(std::move(validator_))
+    {
+    }
+
+    // Releases the snapshot if run() did not (dropped job, throwing validator).
+    ~validation_job() override
+    {
+        release_snapshot(snapshot);
+    }
+
+    void run() override
+    {
+        auto valid = static_cast<bool>(validator(snapshot_value(snapshot)));
+        release_snapshot(snapshot);
+        if (valid)
+        {
+            return;
+        }
+        site_failed(*site);
+        std::ostringstream oss;
+        oss << FORMAT_BEGIN(BOLD_CODE) << site->location << ": " << FORMAT_END
+            << RED_STR("asynchronous assertion check failed: ") << validator_text << "(" << object_text
+            << ") on snapshot #" << sequence << std::endl;
+        emit_failure(oss.str());
+    }
+
+    void report_exception(const char* what) override
+    {
+        release_snapshot(snapshot);
+        site_failed(*site);
+        std::ostringstream oss;
+        oss << FORMAT_BEGIN(BOLD_CODE) << site->location << ": " << FORMAT_END
+            << RED_STR("asynchronous assertion check failed: ") << validator_text << "(" << object_text << ") threw "
+            << exception_text(what) << " on snapshot #" << sequence << std::endl;
+        emit_failure(oss.str());
+    }
+};
+
+MY_ASSERT_CONSTINIT inline std::atomic<unsigned> g_validation_workers{0}; // 0: a quarter of the CPUs
+
+inline check_pool& validation_pool()
+{
+    auto workers = g_validation_workers.load(std::memory_order_relaxed);
+    if (workers == 0)
+    {
+        workers = std::max(1u, std::thread::hardware_concurrency() / 4);
+    }
+    return get_check_pool(g_validation_pool, "asynchronous validations", false, workers);
+}
+
+template <typename Object, typename Validator>
+[[gnu::noinline]] void submit_validation(site_stats& site, std::atomic<std::uint64_t>& sequence,
+                                         const char* object_text, const char* validator_text, const Object& object,
+                                         Validator validator)
+{
+    auto snapshot = make_snapshot(object);
+    using job_type = validation_job<decltype(snapshot), Validator>;
+    auto* job = new job_type(std::move(snapshot), std::move(validator));
+    job->site = &site;
+    job->object_text = object_text;
+    job->validator_text = validator_text;
+    job->sequence = sequence.fetch_add(1, std::memory_order_relaxed);
+    if (!validation_pool().push(job))
+    {
+        delete job;
+    }
+}
+} // namespace detail
+
+// Number of MYASSERT_ASYNC workers (default: a quarter of the CPUs). Takes effect only before the first check.
+inline void set_validation_workers(unsigned workers)
+{
+    detail::g_validation_workers.store(workers, std::memory_order_relaxed);
+}
+
+// Waits until all queued MYASSERT_ASYNC validations have run (e.g. at the end of a test).
+inline void wait_validations()
+{
+    detail::wait_check_pool(detail::g_validation_pool);
+}
+} // namespace my_assert
+#endif // MY_ASSERT_BACKGROUND_CHECKS
+
+// -----------------------------------
+// === Stress campaign checkpoints ===
+// -----------------------------------
+// State of a long stress-testing campaign (seed cursor, corpus of failing inputs, failures per site, coverage
+// counters), checkpointed periodically to a file replaced by rename and resumed from it after a restart.
+// Workers publish the counters of each finished case under a per-worker epoch (seqlock): the checkpoint thread
+// retries a torn read instead of stopping them, and takes no lock a worker needs during a case. A checkpoint that
+// cannot read a worker consistently is not written; the next one retries.
+// No seed is skipped by a resume: seeds in flight at the checkpoint are rerun, so the counters may already
+// include a few of them.
+#ifdef MY_ASSERT_STRESS
+namespace my_assert
+{
+class stress_campaign;
+
+// Per-thread part of a campaign, from stress_campaign::add_worker(). Only its thread calls the methods.
+class stress_worker
+{
+public:
+    static constexpr std::size_t coverage_capacity = 256;
+
+    // Claims the next seed of the campaign.
+    std::uint64_t begin_case()
+    {
+        // The claim is announced before it is made, so a checkpoint never misses a seed in flight.
+        in_flight_.store(next_seed_.load());
+        auto seed = next_seed_.fetch_add(1);
+        in_flight_.store(seed);
+        return seed;
+    }
+
+    // Coverage counter from stress_campaign::coverage_counter(), counted locally until end_case().
+    void cover(std::size_t counter, std::uint64_t count = 1)
+    {
+        local_[counter] += count;
+        local_used_ = std::max(local_used_, counter + 1);
+    }
+
+    // Publishes the coverage of the finished case.
+    void end_case()
+    {
+        auto epoch = epoch_.load(std::memory_order_relaxed);
+        epoch_.store(epoch + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < local_used_; ++i)
+        {
+            if (local_[i])
+            {
+                published_[i].store(published_[i].load(std::memory_order_relaxed) + local_[i],
+                                    std::memory_order_relaxed);
+                local_[i] = 0;
+            }
+        }
+        cases_.store(cases_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        epoch_.store(epoch + 2, std::memory_order_release);
+        in_flight_.store(idle);
+    }
+
+    stress_worker(const stress_worker&) = delete;
+    stress_worker& operator=(const stress_worker&) = delete;
+
+private:
+    friend class stress_campaign;
+
+    static constexpr std::uint64_t idle = ~std::uint64_t{0};
+
+    explicit stress_worker(std::atomic<std::uint64_t>& next_seed) : next_seed_(next_seed)
+    {
+    }
+
+    // Consistent copy of the published counters; false if the worker kept publishing.
+    bool read(std::uint64_t& cases, std::uint64_t* coverage, std::size_t counters) const
+    {
+        for (int attempt = 0; attempt < 1000; ++attempt)
+        {
+            auto before = epoch_.load(std::memory_order_acquire);
+            if (before % 2 == 1)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            cases = cases_.load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i < counters; ++i)
+            {
+                coverage[i] = published_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (epoch_.load(std::memory_order_relaxed) == before)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::atomic<std::uint64_t>& next_seed_;
+    std::atomic<std::uint64_t> in_flight_{idle};
+    std::atomic<std::uint64_t> epoch_{0}; // odd while published counters change
+    std::atomic<std::uint64_t> cases_{0};
+    std::atomic<std::uint64_t> published_[coverage_capacity]{};
+    std::uint64_t local_[coverage_capacity]{};
+    std::size_t local_used_ = 0;
+};
+
+// Usage:
+//    `my_assert::stress_campaign campaign("stress.ckpt");` (resumes if the file exists)
+//    `auto branch = campaign.coverage_counter("branch");` then `campaign.start_checkpoints();`
+//    in each worker thread: `auto& worker = campaign.add_worker();`
+//    `auto seed = worker.begin_case(); ... worker.cover(branch); ... worker.end_case();`
+//    failing inputs: `campaign.add_to_corpus(serialized_input);`
+class stress_campaign
+{
+public:
+    explicit stress_campaign(std::string path) : path_(std::move(path))
+    {
+        resumed_ = load();
+    }
+
+    // Stops periodic checkpoints and writes a final one. Workers must have finished.
+    ~stress_campaign()
+    {
+        stop_checkpoints();
+        checkpoint();
+    }
+
+    stress_campaign(const stress_campaign&) = delete;
+    stress_campaign& operator=(const stress_campaign&) = delete;
+
+    bool resumed() const
+    {
+        return resumed_;
+    }
+
+    // Index of a named coverage counter for stress_worker::cover(); register counters before starting workers.
+    std::size_t coverage_counter(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = std::find(counter_names_.begin(), counter_names_.end(), name);
+        if (found != counter_names_.end())
+        {
+            return static_cast<std::size_t>(found - counter_names_.begin());
+        }
+        if (counter_names_.size() == stress_worker::coverage_capacity)
+        {
+            throw std::length_error("my_assert: too many coverage counters");
+        }
+        counter_names_.push_back(name);
+        counter_base_.push_back(0);
+        return counter_names_.size() - 1;
+    }
+
+    stress_worker& add_worker()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        workers_.push_back(std::unique_ptr<stress_worker>(new stress_worker(next_seed_)));
+        return *workers_.back();
+    }
+
+    void add_to_corpus(std::string entry)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        corpus_.push_back(std::move(entry));
+    }
+
+    std::vector<std::string> corpus() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return corpus_;
+    }
+
+    // Writes a checkpoint to a temporary file, syncs it, renames it over path and syncs the directory.
+    // Returns false on I/O errors, or if a worker kept publishing during every read of its counters.
+    bool checkpoint()
+    {
+        std::lock_guard<std::mutex> checkpoint_lock(checkpoint_mutex_);
+        std::string data;
+        if (!serialize(data))
+        {
+            return false;
+        }
+        auto temp_path = path_ + ".tmp." + std::to_string(::getpid());
+        auto fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        auto written = detail::write_all(fd, data.data(), data.size()) == data.size() && ::fsync(fd) == 0;
+        ::close(fd);
+        if (!written || std::rename(temp_path.c_str(), path_.c_str()) != 0)
+        {
+            ::unlink(temp_path.c_str());
+            return false;
+        }
+        // The rename is durable only once the directory is synced
+        auto slash = path_.rfind('/');
+        auto directory = slash == std::string::npos ? std::string(".") : path_.substr(0, slash + 1);
+        auto directory_fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+        if (directory_fd < 0)
+        {
+            return false;
+        }
+        auto synced = ::fsync(directory_fd) == 0;
+        ::close(directory_fd);
+        return synced;
+    }
+
+    // Checkpoints from a background thread every period.
+    void start_checkpoints(std::chrono::milliseconds period = std::chrono::milliseconds(60000))
+    {
+        std::lock_guard<std::mutex> lock(thread_mutex_);
+        if (thread_.joinable())
+        {
+            return;
+        }
+        stop_ = false;
+        thread_ = std::thread([this, period] {
+            std::unique_lock<std::mutex> lock(thread_mutex_);
+            while (!thread_cv_.wait_for(lock, period, [this] { return stop_; }))
+            {
+                lock.unlock();
+                checkpoint();
+                lock.lock();
+            }
+        });
+    }
+
+    void stop_checkpoints()
+    {
+        {
+            std::lock_guard<std::mutex> lock(thread_mutex_);
+            stop_ = true;
+        }
+        thread_cv_.notify_all();
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+    }
+
+private:
+    static constexpr char magic[8] = {'M', 'Y', 'C', 'K', 'P', 'T', '1', '\n'};
+
+    static void put(std::string& out, std::uint64_t value)
+    {
+        // LEB128: counters and lengths are mostly small
+        do
+        {
+            auto byte = static_cast<char>(value & 0x7f);
+            value >>= 7;
+            out += static_cast<char>(byte | (value ? 0x80 : 0));
+        } while (value);
+    }
+
+    static void put(std::string& out, const std::string& text)
+    {
+        put(out, text.size());
+        out += text;
+    }
+
+    // Format: magic, seed cursor, cases, coverage counters (name, value), site failures (location \t kind \t expr,
+    // count), corpus entries; integers as LEB128, strings length-prefixed. False if a worker cannot be read: its
+    // finished cases are below the cursor and would be lost.
+    bool serialize(std::string& out)
+    {
+        std::vector<stress_worker*> workers;
+        std::vector<std::string> names;
+        std::vector<std::uint64_t> coverage;
+        std::vector<std::string> corpus;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& worker : workers_)
+            {
+                workers.push_back(worker.get());
+            }
+            names = counter_names_;
+            coverage = counter_base_;
+            corpus = corpus_;
+        }
+        // Cursor first: a seed claimed later is above it, a seed claimed earlier is announced in in_flight_.
+        auto cursor = next_seed_.load();
+        auto cases = cases_base_;
+        std::uint64_t worker_coverage[stress_worker::coverage_capacity];
+        for (auto* worker : workers)
+        {
+            cursor = std::min(cursor, worker->in_flight_.load());
+            std::uint64_t worker_cases = 0;
+            if (!worker->read(worker_cases, worker_coverage, coverage.size()))
+            {
+                return false;
+            }
+            cases += worker_cases;
+            for (std::size_t i = 0; i < coverage.size(); ++i)
+            {
+                coverage[i] += worker_coverage[i];
+            }
+        }
+
+        auto sites = site_base_;
+        for (auto* site = detail::g_sites.load(std::memory_order_acquire); site;
+             site = site->next.load(std::memory_order_relaxed))
+        {
+            if (site->kind == detail::site_kind::assertion || site->kind == detail::site_kind::warning)
+            {
+                sites[site_key(*site)] +=
+                    site->hits.load(std::memory_order_relaxed) + site->suppressed.load(std::memory_order_relaxed);
+            }
+        }
+
+        out.assign(magic, sizeof(magic));
+        put(out, cursor);
+        put(out, cases);
+        put(out, names.size());
+        for (std::size_t i = 0; i < names.size(); ++i)
+        {
+            put(out, names[i]);
+            put(out, coverage[i]);
+        }
+        put(out, sites.size());
+        for (const auto& [key, failures] : sites)
+        {
+            put(out, key);
+            put(out, failures);
+        }
+        put(out, corpus.size());
+        for (const auto& entry : corpus)
+        {
+            put(out, entry);
+        }
+        return true;
+    }
+
+    static std::string site_key(const detail::site_stats& site)
+    {
+        return std::string(site.location) + "\t" + detail::site_kind_name(site.kind) + "\t" + site.expr;
+    }
+
+    bool load()
+    {
+        std::ifstream file(path_, std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (data.compare(0, sizeof(magic), magic, sizeof(magic)) != 0)
+        {
+            throw std::runtime_error("my_assert: " + path_ + " is not a stress campaign checkpoint");
+        }
+        std::size_t position = sizeof(magic);
+        auto get = [&]() {
+            std::uint64_t value = 0;
+            for (int shift = 0;; shift += 7)
+            {
+                if (position == data.size() || shift > 63)
+                {
+                    throw std::runtime_error("my_assert: checkpoint " + path_ + " is truncated");
+                }
+                auto byte = static_cast<unsigned char>(data[position++]);
+                value |= std::uint64_t{byte & 0x7fu} << shift;
+                if (!(byte & 0x80))
+                {
+                    return value;
+                }
+            }
+        };
+        auto get_string = [&]() {
+            auto size = get();
+            if (data.size() - position < size)
+            {
+                throw std::runtime_error("my_assert: checkpoint " + path_ + " is truncated");
+            }
+            position += size;
+            return data.substr(position - size, size);
+        };
+        next_seed_.store(get());
+        cases_base_ = get();
+        for (auto count = get(); count > 0; --count)
+        {
+            auto name = get_string();
+            counter_base_[coverage_counter(name)] = get();
+        }
+        for (auto count = get(); count > 0; --count)
+        {
+            auto key = get_string();
+            site_base_[key] = get();
+        }
+        for (auto count = get(); count > 0; --count)
+        {
+            corpus_.push_back(get_string());
+        }
+        return true;
+    }
+
+    std::string path_;
+    bool resumed_ = false;
+    std::atomic<std::uint64_t> next_seed_{0};
+    std::uint64_t cases_base_ = 0;
+    std::unordered_map<std::string, std::uint64_t> site_base_; // failures before the resume
+    mutable std::mutex mutex_; // workers_, counter names, corpus
+    std::vector<std::unique_ptr<stress_worker>> workers_;
+    std::vector<std::string> counter_names_;
+    std::vector<std::uint64_t> counter_base_;
+    std::vector<std::string> corpus_;
+    std::mutex checkpoint_mutex_;
+    std::mutex thread_mutex_;
+    std::condition_variable thread_cv_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+} // namespace my_assert
+#endif // MY_ASSERT_STRESS
+
+// -------------------
+// === Fork safety ===
+// -------------------
+#ifdef MY_ASSERT_HAS_FORK_HANDLERS
+namespace my_assert
+{
+namespace detail
+{
+inline void reset_site_stats(site_stats& site)
+{
+    for (auto* counter :
+         {&site.hits, &site.suppressed, &site.contended, &site.total_ns, &site.max_ns, &site.cost_cycles})
+    {
+        counter->store(0, std::memory_order_relaxed);
+    }
+    for (auto& bucket : site.histogram)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+inline void reset_stats_in_child()
+{
+    if (!g_reset_stats_on_fork.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    for (auto* site = g_sites.load(std::memory_order_acquire); site; site = site->next.load(std::memory_order_relaxed))
+    {
+        reset_site_stats(*site);
+    }
+}
+} // namespace detail
+
+// Zero all counters and histograms in forked children (e.g. per-test statistics in a fork server).
+inline void reset_stats_on_fork(bool enable = true)
+{
+    detail::g_reset_stats_on_fork.store(enable, std::memory_order_relaxed);
+    detail::set_fork_handlers(detail::fork_slot_stats, nullptr, nullptr, detail::reset_stats_in_child);
+}
+} // namespace my_assert
+#endif // MY_ASSERT_HAS_FORK_HANDLERS
@@ -0,0 +1,67 @@
+// Client for my_assert::start_control_socket().
+// Build: g++ -std=c++17 -O2 -pthread tools/my_assert_ctl.cpp -o my_assert_ctl
+// Usage: my_assert_ctl PID|SOCKET_PATH COMMAND...
+//   list                       sites with their state and rate limit
+//   stats                      per-site counters and histograms
+//   enable PATTERN             enable MYDEBUG/MYWARNING sites, e.g. "solver.cpp:*" or "*"
+//   disable PATTERN
+//   rate PATTERN N             at most N records per second (0 is unlimited)
+
+#define MY_ASSERT_CONTROL_SOCKET
+#include "../my_assert.h"
+
+#include <cctype>
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: my_assert_ctl PID|SOCKET_PATH list|stats|enable PATTERN|disable PATTERN|rate PATTERN N"
+                  << std::endl;
+        return 2;
+    }
+    std::string target = argv[1];
+    auto is_pid = std::all_of(target.begin(), target.end(), [](char c) { return std::isdigit(c); });
+    auto path = is_pid ? "/tmp/my_assert." + target + ".sock" : target;
+    std::string command;
+    for (int i = 2; i < argc; ++i)
+    {
+        command += (i > 2 ? " " : "") + std::string(argv[i]);
+    }
+    command += "\n";
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "my_assert_ctl: socket path is too long" << std::endl;
+        return 1;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    auto fd = my_assert::detail::socket_cloexec(AF_UNIX, SOCK_STREAM);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)
+    {
+        std::cerr << "my_assert_ctl: cannot connect to " << path << std::endl;
+        return 1;
+    }
+    my_assert::detail::write_all(fd, command.data(), command.size());
+    char buffer[4096];
+    std::string response;
+    while (true)
+    {
+        auto count = ::read(fd, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            break;
+        }
+        response.append(buffer, static_cast<std::size_t>(count));
+    }
+    ::close(fd);
+    std::cout << response;
+    return response.compare(0, 6, "error:") == 0 ? 1 : 0;
+}
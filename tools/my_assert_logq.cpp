@@ -0,0 +1,609 @@
+// Indexed query tool for logs written by my_assert (plain or compressed, optionally with timestamps).
+// Build: g++ -std=c++17 -O2 -pthread tools/my_assert_logq.cpp -o my_assert_logq
+// Usage:
+//   my_assert_logq LOG --sites                       list sites with record counts
+//   my_assert_logq LOG [--site FILE:LINE] [--expr EXPR] [--from SEC] [--to SEC] [--values]
+// The first query builds LOG.idx next to the log (and rebuilds it when the log changes).
+// Later queries only map the index and read the matching records.
+// Times are Unix seconds, as printed by my_assert::enable_timestamps().
+
+#define MY_ASSERT_ASYNC_OUTPUT
+#include "../my_assert.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cctype>
+#include <iostream>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+constexpr char index_magic[4] = {'M', 'Y', 'I', 'X'};
+constexpr std::uint32_t index_version = 1;
+
+struct mapped_file
+{
+    const char* data = nullptr;
+    std::size_t size = 0;
+    struct stat info = {};
+
+    mapped_file() = default;
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    ~mapped_file()
+    {
+        close();
+    }
+
+    void close()
+    {
+        if (data)
+        {
+            ::munmap(const_cast<char*>(data), size);
+        }
+        data = nullptr;
+        size = 0;
+    }
+
+    bool open(const std::string& path)
+    {
+        close();
+        auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        auto ok = ::fstat(fd, &info) == 0;
+        size = ok ? static_cast<std::size_t>(info.st_size) : 0;
+        if (ok && size > 0)
+        {
+            auto* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = mapped != MAP_FAILED;
+            data = ok ? static_cast<const char*>(mapped) : nullptr;
+        }
+        ::close(fd);
+        return ok;
+    }
+};
+
+std::int64_t mtime_ns(const struct stat& info)
+{
+    return static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+// Block of a compressed log; raw_offset is the position of its first byte in the decoded stream.
+struct block_info
+{
+    std::uint64_t file_offset;
+    std::uint64_t raw_offset;
+    std::uint32_t raw_size;
+    std::uint32_t stored_size; // with lz::stored_flag
+};
+
+// Record position in the decoded stream.
+struct record_ref
+{
+    std::int64_t time_us;
+    std::uint64_t offset;
+    std::uint32_t length;
+    std::uint32_t reserved;
+};
+
+// Decoded view of a plain or compressed log.
+class log_reader
+{
+public:
+    bool open(const std::string& path)
+    {
+        if (!file_.open(path))
+        {
+            return false;
+        }
+        if (file_.size < sizeof(my_assert::lz::stream_magic) ||
+            std::memcmp(file_.data, my_assert::lz::stream_magic, sizeof(my_assert::lz::stream_magic)) != 0)
+        {
+            return true;
+        }
+        compressed_ = true;
+        std::uint64_t position = sizeof(my_assert::lz::stream_magic);
+        std::uint64_t raw_offset = 0;
+        while (position + my_assert::lz::block_header_size <= file_.size)
+        {
+            block_info block{position, raw_offset, my_assert::lz::detail::read32le(file_.data + position),
+                             my_assert::lz::detail::read32le(file_.data + position + 4)};
+            auto stored_size = block.stored_size & ~my_assert::lz::stored_flag;
+            if (position + my_assert::lz::block_header_size + stored_size > file_.size)
+            {
+                break; // truncated tail (e.g. process killed while writing)
+            }
+            blocks_.push_back(block);
+            position += my_assert::lz::block_header_size + stored_size;
+            raw_offset += block.raw_size;
+        }
+        return true;
+    }
+
+    const struct stat& info() const
+    {
+        return file_.info;
+    }
+
+    const std::vector<block_info>& blocks() const
+    {
+        return blocks_;
+    }
+
+    void set_blocks(const block_info* blocks, std::size_t count)
+    {
+        blocks_.assign(blocks, blocks + count);
+    }
+
+    // Calls f(offset, text) for consecutive pieces of the decoded stream.
+    template <typename F>
+    void for_each_chunk(F&& f)
+    {
+        if (!compressed_)
+        {
+            f(0, std::string_view(file_.data, file_.size));
+            return;
+        }
+        std::string raw;
+        for (std::size_t i = 0; i < blocks_.size(); ++i)
+        {
+            decode(i, raw);
+            f(blocks_[i].raw_offset, std::string_view(raw));
+        }
+    }
+
+    std::string read(std::uint64_t offset, std::uint32_t length)
+    {
+        if (!compressed_)
+        {
+            return std::string(file_.data + offset, length);
+        }
+        auto by_offset = [](std::uint64_t value, const block_info& block) { return value < block.raw_offset; };
+        auto it = std::upper_bound(blocks_.begin(), blocks_.end(), offset, by_offset);
+        std::string result;
+        std::string raw;
+        for (auto i = static_cast<std::size_t>(it - blocks_.begin()) - 1; i < blocks_.size() && result.size() < length;
+             ++i)
+        {
+            decode(i, raw);
+            auto begin = offset + result.size() - blocks_[i].raw_offset;
+            result.append(raw, begin, length - result.size());
+        }
+        return result;
+    }
+
+private:
+    void decode(std::size_t index, std::string& raw)
+    {
+        const auto& block = blocks_[index];
+        auto* data = file_.data + block.file_offset + my_assert::lz::block_header_size;
+        auto stored_size = block.stored_size & ~my_assert::lz::stored_flag;
+        if (block.stored_size & my_assert::lz::stored_flag)
+        {
+            raw.assign(data, stored_size);
+            return;
+        }
+        raw.resize(block.raw_size);
+        if (!my_assert::lz::decompress_block(data, stored_size, raw.data(), block.raw_size))
+        {
+            raw.clear();
+        }
+    }
+
+    mapped_file file_;
+    bool compressed_ = false;
+    std::vector<block_info> blocks_;
+};
+
+struct parsed_record
+{
+    std::int64_t time_us = 0;
+    std::string location;
+    std::string kind;
+    std::string expr;
+    std::string value;
+};
+
+std::string strip_colors(std::string_view line)
+{
+    std::string result;
+    for (std::size_t i = 0; i < line.size(); ++i)
+    {
+        if (line[i] == '\033')
+        {
+            auto end = line.find('m', i);
+            i = end == std::string_view::npos ? line.size() : end;
+            continue;
+        }
+        result += line[i];
+    }
+    return result;
+}
+
+// Parses "[sec.usec] file:line: kind: text" (timestamp optional). Returns false for continuation lines.
+bool parse_record(std::string_view line, parsed_record& record)
+{
+    auto text = strip_colors(line);
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+    {
+        text.pop_back();
+    }
+    std::size_t position = 0;
+    record.time_us = 0;
+    if (!text.empty() && text[0] == '[')
+    {
+        auto end = text.find("] ");
+        if (end == std::string::npos)
+        {
+            return false;
+        }
+        record.time_us = static_cast<std::int64_t>(std::strtod(text.c_str() + 1, nullptr) * 1e6 + 0.5);
+        position = end + 2;
+    }
+    // location ends at the first ": " preceded by ":<digits>"
+    for (auto colon = text.find(": ", position); colon != std::string::npos; colon = text.find(": ", colon + 1))
+    {
+        auto digits = colon;
+        while (digits > position && std::isdigit(static_cast<unsigned char>(text[digits - 1])))
+        {
+            --digits;
+        }
+        if (digits == colon || digits == position || text[digits - 1] != ':')
+        {
+            continue;
+        }
+        record.location = text.substr(position, colon - position);
+        auto rest = text.substr(colon + 2);
+        auto kind_end = rest.find(": ");
+        record.kind = kind_end == std::string::npos ? rest : rest.substr(0, kind_end);
+        rest = kind_end == std::string::npos ? "" : rest.substr(kind_end + 2);
+        auto value_begin = record.kind == "debug" ? rest.find(" = ") : std::string::npos;
+        record.expr = value_begin == std::string::npos ? rest : rest.substr(0, value_begin);
+        record.value = value_begin == std::string::npos ? "" : rest.substr(value_begin + 3);
+        return true;
+    }
+    return false;
+}
+
+struct site_entry
+{
+    std::string location;
+    std::string kind;
+    std::string expr;
+    std::vector<record_ref> records;
+};
+
+template <typename T>
+void append_raw(std::string& out, const T& value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void append_string(std::string& out, const std::string& value)
+{
+    append_raw(out, static_cast<std::uint64_t>(value.size()));
+    out += value;
+    out.append((8 - value.size() % 8) % 8, '\0');
+}
+
+bool build_index(log_reader& log, const std::string& index_path)
+{
+    std::vector<site_entry> sites;
+    std::unordered_map<std::string, std::size_t> site_ids; // location + kind
+    site_entry* last_site = nullptr;
+    std::string carry;
+    std::uint64_t carry_offset = 0;
+    parsed_record record;
+    auto on_line = [&](std::uint64_t offset, std::string_view line) {
+        if (!parse_record(line, record))
+        {
+            if (last_site)
+            {
+                last_site->records.back().length += static_cast<std::uint32_t>(line.size());
+            }
+            return;
+        }
+        auto key = record.location + '\n' + record.kind;
+        auto [it, inserted] = site_ids.emplace(key, sites.size());
+        if (inserted)
+        {
+            sites.push_back({record.location, record.kind, record.expr, {}});
+        }
+        last_site = &sites[it->second];
+        last_site->records.push_back({record.time_us, offset, static_cast<std::uint32_t>(line.size()), 0});
+    };
+    log.for_each_chunk([&](std::uint64_t offset, std::string_view chunk) {
+        std::size_t begin = 0;
+        for (auto end = chunk.find('\n'); end != std::string_view::npos; end = chunk.find('\n', begin))
+        {
+            auto line = chunk.substr(begin, end + 1 - begin);
+            if (carry.empty())
+            {
+                on_line(offset + begin, line);
+            }
+            else
+            {
+                carry.append(line);
+                on_line(carry_offset, carry);
+                carry.clear();
+            }
+            begin = end + 1;
+        }
+        if (begin < chunk.size())
+        {
+            if (carry.empty())
+            {
+                carry_offset = offset + begin;
+            }
+            carry.append(chunk.substr(begin));
+        }
+    });
+    if (!carry.empty())
+    {
+        on_line(carry_offset, carry);
+    }
+
+    std::string out(index_magic, sizeof(index_magic));
+    append_raw(out, index_version);
+    append_raw(out, static_cast<std::uint64_t>(log.info().st_size));
+    append_raw(out, mtime_ns(log.info()));
+    append_raw(out, static_cast<std::uint64_t>(sites.size()));
+    append_raw(out, static_cast<std::uint64_t>(log.blocks().size()));
+    for (const auto& block : log.blocks())
+    {
+        append_raw(out, block);
+    }
+    for (auto& site : sites)
+    {
+        std::stable_sort(site.records.begin(), site.records.end(),
+                         [](const record_ref& a, const record_ref& b) { return a.time_us < b.time_us; });
+        append_string(out, site.location);
+        append_string(out, site.kind);
+        append_string(out, site.expr);
+        append_raw(out, static_cast<std::uint64_t>(site.records.size()));
+        out.append(reinterpret_cast<const char*>(site.records.data()), site.records.size() * sizeof(record_ref));
+    }
+
+    auto temp_path = index_path + ".tmp";
+    auto fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    auto written = my_assert::detail::write_all(fd, out.data(), out.size());
+    ::close(fd);
+    return written == out.size() && std::rename(temp_path.c_str(), index_path.c_str()) == 0;
+}
+
+// Sequential reader over the mapped index.
+class index_cursor
+{
+public:
+    index_cursor(const char* data, std::size_t size) : data_(data), end_(data + size) {}
+
+    template <typename T>
+    bool read(T& value)
+    {
+        if (static_cast<std::size_t>(end_ - data_) < sizeof(T))
+        {
+            return false;
+        }
+        std::memcpy(&value, data_, sizeof(T));
+        data_ += sizeof(T);
+        return true;
+    }
+
+    bool read_string(std::string_view& value)
+    {
+        std::uint64_t size = 0;
+        if (!read(size) || static_cast<std::uint64_t>(end_ - data_) < size)
+        {
+            return false;
+        }
+        value = std::string_view(data_, size);
+        data_ += std::min<std::uint64_t>(size + (8 - size % 8) % 8, end_ - data_);
+        return true;
+    }
+
+    // Returns pointer to count objects and skips them (index is 8-byte aligned by construction).
+    template <typename T>
+    const T* take(std::uint64_t count)
+    {
+        if (static_cast<std::uint64_t>(end_ - data_) < count * sizeof(T))
+        {
+            return nullptr;
+        }
+        auto* result = reinterpret_cast<const T*>(data_);
+        data_ += count * sizeof(T);
+        return result;
+    }
+
+private:
+    const char* data_;
+    const char* end_;
+};
+
+struct query
+{
+    bool list_sites = false;
+    bool values = false;
+    std::string site;
+    std::string expr;
+    std::int64_t from_us = std::numeric_limits<std::int64_t>::min();
+    std::int64_t to_us = std::numeric_limits<std::int64_t>::max();
+};
+
+bool matches_location(std::string_view location, const std::string& pattern)
+{
+    if (pattern.empty())
+    {
+        return true;
+    }
+    // "solver.cpp:120" matches "src/solver.cpp:120"
+    return location.size() >= pattern.size() && location.substr(location.size() - pattern.size()) == pattern &&
+           (location.size() == pattern.size() || location[location.size() - pattern.size() - 1] == '/');
+}
+
+int run_query(log_reader& log, const mapped_file& index, const query& q)
+{
+    index_cursor cursor(index.data, index.size);
+    char magic[sizeof(index_magic)];
+    std::uint32_t version = 0;
+    std::uint64_t log_size = 0;
+    std::int64_t log_mtime = 0;
+    std::uint64_t site_count = 0;
+    std::uint64_t block_count = 0;
+    if (!cursor.read(magic) || !cursor.read(version) || !cursor.read(log_size) || !cursor.read(log_mtime) ||
+        !cursor.read(site_count) || !cursor.read(block_count))
+    {
+        return 1;
+    }
+    auto* blocks = cursor.take<block_info>(block_count);
+    if (!blocks)
+    {
+        return 1;
+    }
+    log.set_blocks(blocks, block_count);
+
+    std::vector<record_ref> matches;
+    for (std::uint64_t i = 0; i < site_count; ++i)
+    {
+        std::string_view location;
+        std::string_view kind;
+        std::string_view expr;
+        std::uint64_t count = 0;
+        if (!cursor.read_string(location) || !cursor.read_string(kind) || !cursor.read_string(expr) ||
+            !cursor.read(count))
+        {
+            return 1;
+        }
+        auto* records = cursor.take<record_ref>(count);
+        if (!records)
+        {
+            return 1;
+        }
+        if (!matches_location(location, q.site) || (!q.expr.empty() && expr != q.expr))
+        {
+            continue;
+        }
+        auto* begin = std::lower_bound(records, records + count, q.from_us,
+                                       [](const record_ref& r, std::int64_t t) { return r.time_us < t; });
+        auto* end = std::upper_bound(begin, records + count, q.to_us,
+                                     [](std::int64_t t, const record_ref& r) { return t < r.time_us; });
+        if (q.list_sites)
+        {
+            std::cout << location << ": " << kind << ": " << expr << " (" << (end - begin) << " records)\n";
+            continue;
+        }
+        matches.insert(matches.end(), begin, end);
+    }
+
+    std::sort(matches.begin(), matches.end(), [](const record_ref& a, const record_ref& b) {
+        return a.time_us != b.time_us ? a.time_us < b.time_us : a.offset < b.offset;
+    });
+    parsed_record record;
+    for (const auto& match : matches)
+    {
+        auto text = log.read(match.offset, match.length);
+        if (q.values && parse_record(text, record))
+        {
+            std::cout << record.value << (record.value.empty() || record.value.back() != '\n' ? "\n" : "");
+            continue;
+        }
+        std::cout << text;
+    }
+    return 0;
+}
+
+std::int64_t parse_time(const char* text)
+{
+    return static_cast<std::int64_t>(std::strtod(text, nullptr) * 1e6 + 0.5);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: my_assert_logq LOG [--sites] [--site FILE:LINE] [--expr EXPR] [--from SEC] [--to SEC] "
+                     "[--values]"
+                  << std::endl;
+        return 2;
+    }
+    std::string log_path = argv[1];
+    query q;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto has_value = i + 1 < argc;
+        if (arg == "--sites")
+        {
+            q.list_sites = true;
+        }
+        else if (arg == "--values")
+        {
+            q.values = true;
+        }
+        else if (arg == "--site" && has_value)
+        {
+            q.site = argv[++i];
+        }
+        else if (arg == "--expr" && has_value)
+        {
+            q.expr = argv[++i];
+        }
+        else if (arg == "--from" && has_value)
+        {
+            q.from_us = parse_time(argv[++i]);
+        }
+        else if (arg == "--to" && has_value)
+        {
+            q.to_us = parse_time(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "my_assert_logq: unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    log_reader log;
+    if (!log.open(log_path))
+    {
+        std::cerr << "my_assert_logq: cannot open " << log_path << std::endl;
+        return 1;
+    }
+    auto index_path = log_path + ".idx";
+    mapped_file index;
+    auto fresh = [&] {
+        std::uint64_t log_size = 0;
+        std::int64_t log_mtime = 0;
+        index_cursor cursor(index.data, index.size);
+        char magic[sizeof(index_magic)];
+        std::uint32_t version = 0;
+        return cursor.read(magic) && std::memcmp(magic, index_magic, sizeof(magic)) == 0 && cursor.read(version) &&
+               version == index_version && cursor.read(log_size) && cursor.read(log_mtime) &&
+               log_size == static_cast<std::uint64_t>(log.info().st_size) && log_mtime == mtime_ns(log.info());
+    };
+    if (!index.open(index_path) || !fresh())
+    {
+        if (!build_index(log, index_path))
+        {
+            std::cerr << "my_assert_logq: cannot write " << index_path << std::endl;
+            return 1;
+        }
+        if (!index.open(index_path))
+        {
+            return 1;
+        }
+    }
+    return run_query(log, index, q);
+}
@@ -0,0 +1,115 @@
+// Checks of MYDEBUG value printing (aggregates, enums, arrays), in every standard and optimization level:
+// field names are compile-time constants, so C++20 at -O0 must link.
+// Build: g++ -std=c++20 -O0 -pthread tools/my_assert_print_check.cpp -o my_assert_print_check
+//        g++ -std=c++17 -O2 -pthread tools/my_assert_print_check.cpp -o my_assert_print_check
+// Usage: my_assert_print_check (exit status 1 and the mismatches on stderr if a value is printed wrongly)
+
+#include "../my_assert.h"
+
+#include <iostream>
+#include <vector>
+
+namespace
+{
+struct point
+{
+    int x;
+    double y;
+};
+
+struct nested
+{
+    std::string name;
+    std::vector<int> values;
+    point where;
+    int window[1];
+};
+
+enum class color
+{
+    red,
+    green
+};
+
+enum shape
+{
+    circle,
+    square
+};
+
+enum class named
+{
+    first
+};
+
+std::ostream& operator<<(std::ostream& os, named)
+{
+    return os << "named::first";
+}
+
+enum unscoped_named
+{
+    only
+};
+
+std::ostream& operator<<(std::ostream& os, unscoped_named)
+{
+    return os << "unscoped_named::only";
+}
+
+struct with_array
+{
+    int a[3];
+    int b;
+};
+
+struct base
+{
+    int a;
+};
+
+struct derived : base
+{
+    int b;
+};
+
+struct too_many
+{
+    int a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p, q;
+};
+
+// Not printed field by field: structured bindings cannot decompose them as counted (static_assert in MYDEBUG).
+static_assert(!my_assert::detail::prints_fields<with_array>());
+static_assert(!my_assert::detail::prints_fields<derived>());
+static_assert(!my_assert::detail::prints_fields<too_many>());
+static_assert(my_assert::detail::prints_fields<nested>());
+
+int failures = 0;
+
+template <typename T>
+void expect(const T& value, const std::string& expected17, const std::string& expected20)
+{
+    std::ostringstream oss;
+    oss << my_assert::detail::printable(value);
+    auto expected = __cplusplus >= 202002L ? expected20 : expected17;
+    if (oss.str() != expected)
+    {
+        std::cerr << "printed " << oss.str() << ", expected " << expected << std::endl;
+        ++failures;
+    }
+}
+} // namespace
+
+int main()
+{
+    expect(point{1, 2.5}, "{1, 2.5}", "{x = 1, y = 2.5}");
+    expect(nested{"n", {1, 2}, {3, 4}, {5}}, "{n, [1, 2], {3, 4}, [5]}",
+           "{name = n, values = [1, 2], where = {x = 3, y = 4}, window = [5]}");
+    expect(color::green, "green", "green");
+    expect(square, "square", "square");
+    expect(named::first, "named::first", "named::first");
+    expect(only, "unscoped_named::only", "unscoped_named::only");
+    int array[] = {1, 2, 3};
+    expect(array, "[1, 2, 3]", "[1, 2, 3]");
+    return failures ? 1 : 0;
+}
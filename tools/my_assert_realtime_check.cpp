@@ -0,0 +1,259 @@
+// Check of the MY_ASSERT_REALTIME guarantees, by interposition of the allocator and the blocking primitives:
+// - producers never allocate, free, lock a mutex, wait on a condition variable or futex, or sleep;
+// - the drain thread is idle (no context switches) while nothing is logged;
+// - forked children never deadlock on the drain lock and keep draining.
+// Build: g++ -std=c++17 -O2 -pthread tools/my_assert_realtime_check.cpp -o my_assert_realtime_check -ldl
+// Usage: my_assert_realtime_check 2>/dev/null (exit status 1 and the violations on stdout if a guarantee is broken;
+//        stderr gets the records of the checks)
+
+#define MY_ASSERT_REALTIME
+#include "../my_assert.h"
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <cstdarg>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace
+{
+thread_local bool t_checked = false; // inside the real-time section of this thread
+std::atomic<int> g_violations{0};
+std::atomic<const char*> g_first_violation{nullptr};
+
+void violation(const char* what)
+{
+    if (t_checked)
+    {
+        const char* expected = nullptr;
+        g_first_violation.compare_exchange_strong(expected, what);
+        g_violations.fetch_add(1);
+    }
+}
+
+template <typename F>
+F next_symbol(const char* name)
+{
+    return reinterpret_cast<F>(::dlsym(RTLD_NEXT, name));
+}
+} // namespace
+
+extern "C"
+{
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* pointer, std::size_t size);
+void __libc_free(void* pointer);
+
+void* malloc(std::size_t size)
+{
+    violation("malloc");
+    return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size)
+{
+    violation("calloc");
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, std::size_t size)
+{
+    violation("realloc");
+    return __libc_realloc(pointer, size);
+}
+
+void free(void* pointer)
+{
+    violation("free");
+    __libc_free(pointer);
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    violation("pthread_mutex_lock");
+    static auto next = next_symbol<int (*)(pthread_mutex_t*)>("pthread_mutex_lock");
+    return next(mutex);
+}
+
+int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex)
+{
+    violation("pthread_cond_wait");
+    static auto next = next_symbol<int (*)(pthread_cond_t*, pthread_mutex_t*)>("pthread_cond_wait");
+    return next(condition, mutex);
+}
+
+int nanosleep(const timespec* duration, timespec* remaining)
+{
+    violation("nanosleep");
+    static auto next = next_symbol<int (*)(const timespec*, timespec*)>("nanosleep");
+    return next(duration, remaining);
+}
+
+// FUTEX_WAKE is allowed (it never blocks), every other futex operation waits.
+long syscall(long number, ...)
+{
+    va_list list;
+    va_start(list, number);
+    long args[6];
+    for (auto& arg : args)
+    {
+        arg = va_arg(list, long);
+    }
+    va_end(list);
+    if (number == SYS_futex && (args[1] & FUTEX_CMD_MASK) != FUTEX_WAKE)
+    {
+        violation("futex wait");
+    }
+    static auto next = next_symbol<long (*)(long, ...)>("syscall");
+    return next(number, args[0], args[1], args[2], args[3], args[4], args[5]);
+}
+}
+
+void* operator new(std::size_t size)
+{
+    violation("operator new");
+    if (auto* pointer = __libc_malloc(size ? size : 1))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    violation("operator delete");
+    __libc_free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    violation("operator delete");
+    __libc_free(pointer);
+}
+
+namespace
+{
+int failures = 0;
+
+void check(bool ok, const std::string& what)
+{
+    if (!ok)
+    {
+        std::cout << "my_assert_realtime_check: " << what << std::endl;
+        ++failures;
+    }
+}
+
+// Records of every kind, failing and passing, enough to overflow the ring.
+void real_time_section(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+    {
+        MYASSERT(i >= 0, "negative index");
+        MYASSERT(i % 97 != 5, "bad frame");
+        MYWARNING(i % 89 != 3);
+        if (i % 113 == 0)
+        {
+            MYDEBUG(i);
+        }
+    }
+}
+
+std::uint64_t voluntary_switches()
+{
+    std::uint64_t total = 0;
+    auto* directory = ::opendir("/proc/self/task");
+    while (auto* entry = directory ? ::readdir(directory) : nullptr)
+    {
+        std::ifstream status(std::string("/proc/self/task/") + entry->d_name + "/status");
+        std::string line;
+        while (std::getline(status, line))
+        {
+            if (line.rfind("voluntary_ctxt_switches:", 0) == 0)
+            {
+                total += std::stoull(line.substr(line.find(':') + 1));
+            }
+        }
+    }
+    if (directory)
+    {
+        ::closedir(directory);
+    }
+    return total;
+}
+} // namespace
+
+int main()
+{
+    my_assert::realtime_thread_init();
+    std::thread worker([] {
+        my_assert::realtime_thread_init();
+        t_checked = true;
+        real_time_section(20000);
+        t_checked = false;
+    });
+    t_checked = true;
+    real_time_section(20000);
+    // The drain thread is asleep now: the next record takes the wake-up path.
+    t_checked = false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    t_checked = true;
+    real_time_section(1000);
+    t_checked = false;
+    worker.join();
+    auto* first = g_first_violation.load();
+    check(g_violations.load() == 0, std::to_string(g_violations.load()) + " blocking or allocating calls in the " +
+                                        "real-time section, first: " + (first ? first : ""));
+    check(my_assert::realtime_failed(), "failures not flagged");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    auto before = voluntary_switches();
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    auto switches = voluntary_switches() - before;
+    check(switches < 10, std::to_string(switches) + " context switches of an idle process in 500 ms");
+
+    // Children forked while the drain thread writes must exit (their atexit drain takes the drain lock).
+    std::vector<pid_t> children;
+    for (int i = 0; i < 300; ++i)
+    {
+        real_time_section(200);
+        auto pid = ::fork();
+        if (pid == 0)
+        {
+            real_time_section(10);
+            std::exit(0);
+        }
+        children.push_back(pid);
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    auto hung = 0;
+    for (auto pid : children)
+    {
+        int status = 0;
+        while (::waitpid(pid, &status, WNOHANG) == 0)
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                ::kill(pid, SIGKILL);
+                ::waitpid(pid, &status, 0);
+                ++hung;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    check(hung == 0, std::to_string(hung) + " of 300 forked children hung");
+    if (failures == 0)
+    {
+        std::cout << "my_assert_realtime_check: ok" << std::endl;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+// Startup-time benchmark: the same hello world with and without my_assert.h.
+// Build: g++ -std=c++17 -O2 -pthread tools/my_assert_startup.cpp -o hello_plain
+//        g++ -std=c++17 -O2 -pthread -DWITH_MY_ASSERT tools/my_assert_startup.cpp -o hello_my_assert
+// Usage: ./hello_plain RUNS ./hello_plain ./hello_my_assert
+// Without arguments the binary is the hello world; with arguments it spawns each program RUNS times and prints
+// the median and minimum wall time from posix_spawn to exit (runs are interleaved, output goes to /dev/null).
+
+#ifdef WITH_MY_ASSERT
+#    define MY_ASSERT_ALL_FEATURES
+#    include "../my_assert.h"
+#endif
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+extern char** environ;
+
+namespace
+{
+// Microseconds from spawn to exit of one run, negative if the program failed.
+double run_once(char* program)
+{
+    char* argv[] = {program, nullptr};
+    auto start = std::chrono::steady_clock::now();
+    posix_spawn_file_actions_t actions;
+    ::posix_spawn_file_actions_init(&actions);
+    ::posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    pid_t pid;
+    auto spawned = ::posix_spawn(&pid, program, &actions, nullptr, argv, environ) == 0;
+    ::posix_spawn_file_actions_destroy(&actions);
+    if (!spawned)
+    {
+        return -1;
+    }
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? elapsed : -1;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc == 1)
+    {
+#ifdef WITH_MY_ASSERT
+        MYASSERT(argc == 1);
+#endif
+        std::puts("hello");
+        return 0;
+    }
+    if (argc < 3)
+    {
+        std::fprintf(stderr, "usage: %s RUNS PROGRAM...\n", argv[0]);
+        return 2;
+    }
+    auto runs = std::max(1, std::atoi(argv[1]));
+    std::printf("%-32s %12s %12s\n", "program", "median us", "min us");
+    std::vector<std::vector<double>> times(argc - 2);
+    for (int run = -1; run < runs; ++run) // run -1 warms up the page cache
+    {
+        for (int i = 2; i < argc; ++i)
+        {
+            auto elapsed = run_once(argv[i]);
+            if (elapsed < 0)
+            {
+                std::fprintf(stderr, "%s failed\n", argv[i]);
+                return 1;
+            }
+            if (run >= 0)
+            {
+                times[i - 2].push_back(elapsed);
+            }
+        }
+    }
+    for (int i = 2; i < argc; ++i)
+    {
+        auto& program_times = times[i - 2];
+        std::sort(program_times.begin(), program_times.end());
+        std::printf("%-32s %12.1f %12.1f\n", argv[i], program_times[program_times.size() / 2],
+                    program_times.front());
+    }
+    return 0;
+}
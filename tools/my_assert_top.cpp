@@ -0,0 +1,156 @@
+// Terminal viewer for statistics published by my_assert::start_shm_stats().
+// Build: g++ -std=c++17 -O2 -pthread tools/my_assert_top.cpp -o my_assert_top
+// Usage: my_assert_top PID [ROWS]
+// Polls the segment once per second and shows the hottest sites and failure rates since the previous poll.
+
+#define MY_ASSERT_SHM_STATS
+#include "../my_assert.h"
+
+#include <signal.h>
+
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+
+namespace
+{
+// Consistent copy of the segment (seqlock read).
+bool read_snapshot(const my_assert::shm::segment& shared, my_assert::shm::segment& snapshot)
+{
+    for (int attempt = 0; attempt < 100; ++attempt)
+    {
+        auto before = shared.sequence.load(std::memory_order_acquire);
+        if (before % 2 == 1)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        std::memcpy(static_cast<void*>(&snapshot), &shared, sizeof(snapshot));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (shared.sequence.load(std::memory_order_relaxed) == before)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::uint64_t failures(const my_assert::shm::site_record& site)
+{
+    switch (static_cast<my_assert::detail::site_kind>(site.kind))
+    {
+    case my_assert::detail::site_kind::assertion:
+    case my_assert::detail::site_kind::warning:
+        return site.hits + site.suppressed;
+    default:
+        return 0;
+    }
+}
+
+// Evaluations of checks when the process counts them (MY_ASSERT_EVAL_COUNTERS), hits otherwise.
+std::uint64_t activity(const my_assert::shm::site_record& site)
+{
+    return site.evaluations ? site.evaluations : site.hits;
+}
+
+struct row
+{
+    const my_assert::shm::site_record* site;
+    std::uint64_t hits_delta;
+    std::uint64_t failures_delta;
+};
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: my_assert_top PID [ROWS]" << std::endl;
+        return 2;
+    }
+    auto pid = std::atoll(argv[1]);
+    auto rows = argc > 2 ? std::atoi(argv[2]) : 30;
+    auto name = my_assert::shm::segment_name(pid);
+    auto fd = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        std::cerr << "my_assert_top: no statistics segment " << name << std::endl;
+        return 1;
+    }
+    auto* memory = ::mmap(nullptr, sizeof(my_assert::shm::segment), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+    {
+        std::cerr << "my_assert_top: cannot map " << name << std::endl;
+        return 1;
+    }
+    const auto& shared = *static_cast<const my_assert::shm::segment*>(memory);
+    if (std::memcmp(shared.magic, my_assert::shm::segment_magic, sizeof(shared.magic)) != 0 ||
+        shared.version != my_assert::shm::segment_version)
+    {
+        std::cerr << "my_assert_top: unsupported segment version" << std::endl;
+        return 1;
+    }
+
+    auto snapshot = std::make_unique<my_assert::shm::segment>();
+    std::map<std::string, std::pair<std::uint64_t, std::uint64_t>> previous; // hits, failures
+    while (::kill(static_cast<pid_t>(pid), 0) == 0)
+    {
+        if (!read_snapshot(shared, *snapshot))
+        {
+            continue;
+        }
+        std::vector<row> table;
+        for (std::uint32_t i = 0; i < snapshot->site_count && i < my_assert::shm::site_capacity; ++i)
+        {
+            const auto& site = snapshot->sites[i];
+            auto key = std::string(site.location) + " " + std::to_string(site.kind);
+            auto& last = previous[key];
+            auto site_failures = failures(site);
+            table.push_back({&site, activity(site) - last.first, site_failures - last.second});
+            last = {activity(site), site_failures};
+        }
+        std::sort(table.begin(), table.end(), [](const row& a, const row& b) {
+            return a.failures_delta != b.failures_delta ? a.failures_delta > b.failures_delta
+                                                        : a.hits_delta > b.hits_delta;
+        });
+
+        std::ostringstream oss;
+        oss << "\033[H\033[2J" << BOLD_STR("my_assert_top") << " pid " << pid << ", " << snapshot->site_count
+            << " sites\n\n"
+            << INVERSE_STR("      hits/s        total     fails/s      avg us      max us  kind       location / expr")
+            << "\n";
+        for (int i = 0; i < rows && i < static_cast<int>(table.size()); ++i)
+        {
+            const auto& site = *table[i].site;
+            auto kind = static_cast<my_assert::detail::site_kind>(site.kind);
+            auto timed = kind == my_assert::detail::site_kind::timer || kind == my_assert::detail::site_kind::lock;
+            auto timed_count = kind == my_assert::detail::site_kind::lock ? site.contended : site.hits;
+            oss << std::setw(12) << table[i].hits_delta << std::setw(13) << activity(site);
+            if (table[i].failures_delta > 0)
+            {
+                oss << FORMAT_BEGIN(RED_FG_CODE) << std::setw(12) << table[i].failures_delta << FORMAT_END;
+            }
+            else
+            {
+                oss << std::setw(12) << table[i].failures_delta;
+            }
+            if (timed && timed_count > 0)
+            {
+                oss << std::fixed << std::setprecision(1) << std::setw(12) << site.total_ns / 1e3 / timed_count
+                    << std::setw(12) << site.max_ns / 1e3;
+            }
+            else
+            {
+                oss << std::setw(12) << "-" << std::setw(12) << "-";
+            }
+            oss << "  " << std::left << std::setw(10) << my_assert::detail::site_kind_name(kind) << std::right << " "
+                << FORMAT_BEGIN(BOLD_CODE) << site.location << FORMAT_END << " " << site.expr << "\n";
+        }
+        std::cout << oss.str() << std::flush;
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+    std::cout << "process " << pid << " exited" << std::endl;
+    return 0;
+}
@@ -0,0 +1,28 @@
+// Decoder for compressed logs written by my_assert::enable_file_output(path, true).
+// Build: g++ -std=c++17 -O2 -pthread tools/my_assert_unlz.cpp -o my_assert_unlz
+// Usage: my_assert_unlz [file]   (reads stdin if no file, writes decoded text to stdout)
+
+#define MY_ASSERT_ASYNC_OUTPUT
+#include "../my_assert.h"
+
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+    auto fd = 0;
+    if (argc > 1)
+    {
+        fd = ::open(argv[1], O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            std::cerr << "my_assert_unlz: cannot open " << argv[1] << std::endl;
+            return 1;
+        }
+    }
+    if (!my_assert::lz::decompress_stream(fd, 1))
+    {
+        std::cerr << "my_assert_unlz: malformed stream" << std::endl;
+        return 1;
+    }
+    return 0;
+}